@@ -0,0 +1,63 @@
+#ifndef CKPT_H
+#define CKPT_H
+
+#include "common.h"
+
+/* Snapshot of a whole simulation at the start of a time slot, to go on
+ * from it later any number of times (see os_opts.checkpoint). It holds
+ * the state of the kernel in native byte order, so it is only read back
+ * by the same build. The storage of the memory devices comes last, each
+ * device at a CKPT_ALIGN boundary and with its pages of zeros left as
+ * holes, and is mapped back copy-on-write rather than read */
+#define CKPT_MAGIC	"OSCKPT"
+#define CKPT_VERSION	1
+#define CKPT_ALIGN	65536	/* Alignment of device storage in the file */
+#define CKPT_CHUNK	4096	/* Storage written or skipped at a time */
+#define CKPT_LIST_MAX	(1 << 24)	/* Longest list read back */
+
+struct ckpt;
+
+/* Write a snapshot to [path]. It only replaces the file once complete,
+ * see ckpt_close(). NULL if it cannot be created */
+struct ckpt * ckpt_create(const char * path);
+
+/* Read the snapshot at [path]. NULL if it cannot be opened or was not
+ * written by this build */
+struct ckpt * ckpt_open(const char * path);
+
+/* Finish a snapshot: write the storage of the devices it holds, or map
+ * it back. Return 0 if every read and write went through */
+int ckpt_close(struct ckpt * ck);
+
+void ckpt_put(struct ckpt * ck, const void * buf, size_t size);
+
+/* Return 0 if [size] bytes were read into [buf] */
+int ckpt_get(struct ckpt * ck, void * buf, size_t size);
+
+#define CKPT_PUT(ck, v)	ckpt_put(ck, &(v), sizeof(v))
+#define CKPT_GET(ck, v)	ckpt_get(ck, &(v), sizeof(v))
+
+/* Processes are referred to by their index in the order they were
+ * added, or given by ckpt_set_proc() when reading. ckpt_put_proc()
+ * writes that index, -1 for a process that was not added, and
+ * ckpt_get_proc() reads one back, NULL for -1 or a bad index */
+int ckpt_add_proc(struct ckpt * ck, struct pcb_t * proc);
+int ckpt_proc_index(const struct ckpt * ck, const struct pcb_t * proc);
+int ckpt_nprocs(const struct ckpt * ck);
+struct pcb_t * ckpt_proc(const struct ckpt * ck, int index);
+void ckpt_put_proc(struct ckpt * ck, const struct pcb_t * proc);
+void ckpt_set_proc(struct ckpt * ck, int index, struct pcb_t * proc);
+struct pcb_t * ckpt_get_proc(struct ckpt * ck);
+
+/* Memory of a process: page table, areas, regions and swap order */
+void ckpt_put_mm(struct ckpt * ck, const struct mm_struct * mm);
+int ckpt_get_mm(struct ckpt * ck, struct mm_struct * mm);
+
+/* Release what ckpt_get_mm() allocated, not [mm] itself */
+void ckpt_free_mm(struct mm_struct * mm);
+
+/* A memory device. Its storage follows at ckpt_close() */
+void ckpt_put_memphy(struct ckpt * ck, struct memphy_struct * mp);
+int ckpt_get_memphy(struct ckpt * ck, struct memphy_struct * mp);
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef CODE_H
+#define CODE_H
+
+#include "common.h"
+
+/* Packed encoding of a code segment. An instruction is its opcode byte
+ * followed by its operands, each one an unsigned LEB128 number (7 bits
+ * per byte, high bit set on all bytes but the last), so a calc takes a
+ * single byte. Jump targets are the exception: they are stored as a
+ * fixed 4-byte little endian offset in the image, so the layout of the
+ * image is known before the targets are resolved.
+ *
+ * Once encoded, the program counter of a process is a byte offset in
+ * code->image and code->size is the length of the image, until the
+ * code is decoded, see decode(). */
+
+/* Compiled program file, see oscc. The header is followed by the
+ * [size] bytes of the packed image. The loader does not parse it but
+ * does not map the file either: it copies the image on purpose, so a
+ * rewrite of the file after verify() cannot change the code that runs.
+ * The copy is released once decoded, see decode() */
+#define CODE_MAGIC	"OSBC"
+#define CODE_VERSION	1
+
+struct code_hdr {
+	char magic[4];
+	uint32_t version;	// CODE_VERSION, bumped when the encoding changes
+	uint32_t priority;
+	uint32_t count;
+	uint32_t size;
+};
+
+/* Build code->image from the [code->count] instructions of code->text.
+ * Jump targets given as instruction indexes are turned into offsets.
+ * Return 0 on success, -1 if the text holds an unknown opcode or an
+ * out-of-range jump target. */
+int encode(struct code_seg_t * code);
+
+/* Build code->image for a job of a recorded trace: [burst] slots of
+ * CPU, run between the alloc of [mem] bytes to region 0 and its free
+ * when [mem] is not 0. A long burst is a counted loop of calc, so the
+ * image has the same small size whatever the burst. Return 0 on
+ * success, -1 if the job cannot be encoded */
+int encode_job(struct code_seg_t * code, uint32_t burst, arg_t mem);
+
+/* Demand-paged code. A compiled program of CODE_DEMAND_MIN bytes or
+ * more is not read whole: code->image is NULL and code->fd reads it. Each
+ * process running it keeps the last CODE_WINDOW chunks of CODE_CHUNK
+ * bytes it executed and evicts the least recently used one. A slot
+ * also holds the CODE_INST_MAX bytes following its chunk so that an
+ * instruction starting in the chunk is always whole */
+#define CODE_INST_MAX	48	/* opcode byte + 4 LEB128 64-bit operands */
+
+struct code_window {
+	uint32_t chunk[CODE_WINDOW];	// Chunk held by each slot
+	uint32_t used[CODE_WINDOW];	// Tick of the last use, 0 if empty
+	uint32_t tick;
+	int last;			// Slot of the last hit, tried first
+	uint8_t buf[CODE_WINDOW][CODE_CHUNK + CODE_INST_MAX];
+};
+
+/* Window for a process running [code], NULL if [code] is in memory */
+struct code_window * code_window_new(const struct code_seg_t * code);
+
+/* Check a whole encoded program once, so the CPU never has to:
+ * opcodes, instruction lengths, register and region indexes, ALLOC
+ * sizes, syscall numbers and jump targets. The chunks of demand-paged
+ * code are hashed on the way, and a chunk read again later must hash
+ * the same. Return 0 if [code] is safe to run */
+int verify(const struct code_seg_t * code);
+
+/* Heap the program needs when run straight through, jumps not taken,
+ * so that init_mm() can reserve it up front. 0 without paging */
+addr_t heap_demand(const struct code_seg_t * code);
+
+/* Decode the instruction at offset [pc] into [ins]. Return the offset
+ * of the following instruction. [win] is the window of the process,
+ * NULL if [code] is in memory */
+uint32_t fetch(const struct code_seg_t * code, struct code_window * win,
+		uint32_t pc, struct inst_t * ins);
+
+/* Handlers decode() resolves the instructions to, by opcode. Set once
+ * by the CPU before any code is loaded, see cpu_init(). Code is not
+ * decoded until then */
+void decode_handlers(const exec_t * exec);
+
+/* Decode code->image once into code->dec and release the image, so the
+ * CPU runs it with no fetch and no lookup of its handler. The program
+ * counter is then an index in code->dec, jump targets too, and
+ * code->size is code->count. A calc holds in arg_0 the length of the
+ * calc run it starts. Demand-paged code and code with an operand wider
+ * than 32 bits are left alone: code->dec stays NULL and the CPU fetches
+ * from the image */
+void decode(struct code_seg_t * code);
+
+/* Number of consecutive calc at offset [pc], at most [max]. A run may
+ * be reported in pieces for demand-paged code */
+uint32_t calc_run(const struct code_seg_t * code, struct code_window * win,
+		uint32_t pc, uint32_t max);
+
+/* Write [code] as a compiled program file. Return 0 on success */
+int code_write(FILE * file, const struct code_seg_t * code, uint32_t priority);
+
+#endif
@@ -5,6 +5,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>	/* pthread_mutex_t, <pthread.h> would find sched.h */
 
 #ifndef OSCFG_H
 #include "os-cfg.h"
@@ -24,6 +25,8 @@
 #define NUM_PAGES (1 << (ADDRESS_SIZE - OFFSET_LEN))
 #define PAGE_SIZE (1 << OFFSET_LEN)
 
+#define NUM_REGS 10
+
 /* 
  * @bksysnet: long address mode of 64bit argument support
  */
@@ -55,6 +58,21 @@ enum ins_opcode_t
 	READ,  // Write data to a byte on memory
 	WRITE, // Read data from a byte on memory
 	SYSCALL,
+	MEMCPY, // Copy a block of bytes between two memory regions
+	MEMSET, // Fill a block of bytes of a memory region
+	SUM,    // Sum of the bytes of a memory region into a register
+	CSUM,   // Checksum of a memory region into a register
+	MIN,    // Smallest byte of a memory region into a register
+	MAX,    // Largest byte of a memory region into a register
+	MEMCMP, // Compare two memory regions into a register
+	SET,    // Load an immediate value into a register
+	ADD,    // Register arithmetic, rd = rs op rt
+	SUB,
+	MUL,
+	CMP,    // rd = 0 if rs == rt, 1 if rs > rt, all ones if rs < rt
+	JMP,    // Continue at an instruction index
+	JZ,     // Jump if a register is zero
+	JNZ,    // Jump if a register is not zero
 };
 
 /* instructions executed by the CPU */
@@ -67,10 +85,35 @@ struct inst_t
 	arg_t arg_3;
 };
 
+struct pcb_t;
+
+/* Handler of an instruction, with its operands, see cpu.c */
+typedef int (*exec_t)(struct pcb_t *, arg_t, arg_t, arg_t, arg_t);
+
+/* Instruction decoded from the packed image, see decode(). Smaller
+ * than an inst_t, the operands of decoded code fit in 32 bits */
+struct dinst_t
+{
+	exec_t exec;		// Handler the CPU calls it with
+	uint32_t arg_0;
+	uint32_t arg_1;
+	uint32_t arg_2;
+	uint32_t arg_3;
+	enum ins_opcode_t opcode;
+};
+
 struct code_seg_t
 {
-	struct inst_t *text;
-	uint32_t size;
+	struct inst_t *text;	// Parsed program, released once encoded
+	uint8_t *image;		// Packed program, see code.h
+	struct dinst_t *dec;	// Image decoded once, replaces it, see decode()
+	uint32_t count;		// Number of instructions
+	uint32_t size;		// Length of the image, pc runs up to it
+	int compiled;		// Loaded from a compiled program, see code.h
+	int verified;		// Passed verify(), its memory calls run unchecked
+	int fd;			// Compiled program read on demand, -1 if none
+	uint64_t *sum;		// Hash of each chunk read on demand, see verify()
+	addr_t heap;		// Heap reserved at start, see heap_demand()
 };
 
 struct trans_table_t
@@ -103,21 +146,32 @@ struct pcb_t
 	uint32_t priority;	 // Default priority, this legacy process based (FIXED)
 	char path[100];
 	struct code_seg_t *code; // Code segment
-	addr_t regs[10];	 // Registers, store address of allocated regions
-	uint32_t pc;		 // Program pointer, point to the next instruction
+	struct code_window *win; // Fetched chunks of demand-paged code
+	addr_t regs[NUM_REGS];	 // Registers, store address of allocated regions
+	uint32_t pc;		 // Program pointer, offset of the next instruction
 #ifdef MLQ_SCHED
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;
 #endif
 	struct krnl_t *krnl;	
+	struct mm_struct *mm;		 // Memory prepared by the loader, becomes krnl->mm
 	struct page_table_t *page_table; // Page table
 	uint32_t bp;			 // Break pointer
+	uint64_t arrival;		 // Slot the process was admitted in
+	uint64_t cpu_time;		 // Slots it ran so far
+	int quiet;			 // Fast-forwarded, no IODUMP, see fast_forward()
 };
 
-/* Kernel structure */
+/* Kernel structure. Each simulation has its own, so that several may
+ * run side by side in one host process (see os.h) */
 struct krnl_t
 {
+	struct sched_t *sched;	 // Ready queues, see sched.c
+	struct ktimer_t *timer;	 // Clock of this kernel
+	struct stats_t *stats;
+	struct evlog *evlog;	 // Event log of the run, NULL if not recorded
+	FILE *out;		 // Where the run is logged
 	struct queue_t *ready_queue;
 	struct queue_t *running_list;
 #ifdef MLQ_SCHED
@@ -129,6 +183,7 @@ struct krnl_t
 	struct memphy_struct **mswp;
 	struct memphy_struct *active_mswp;
 	uint32_t active_mswp_id;
+	pthread_mutex_t mmvm_lock;	// Guards the memory regions, see libmem.c
 #endif
 };
 
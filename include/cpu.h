@@ -4,10 +4,45 @@
 
 #include "common.h"
 
+/* Let decode() resolve each instruction to its handler here, so the
+ * CPU calls it directly. Before any code is loaded */
+void cpu_init(void);
+
 /* Execute an instruction of a process. Return 0
  * if the instruction is executed successfully.
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
+/* Execute up to [n] instructions of a process in one call, e.g. a whole
+ * quantum. Return the number of instructions executed. */
+uint32_t run_n(struct pcb_t * proc, uint32_t n);
+
+/* As run_n(), but only count the instructions that set no register
+ * instead of running them: WRITE, MEMCPY, MEMSET, SYSCALL and, with
+ * paging, READ. They leave no output either. All that sets a register
+ * still runs, so the process takes the same path unless it branches on
+ * a value it stored while fast-forwarded */
+uint32_t fast_forward(struct pcb_t * proc, uint32_t n);
+
+/* Whether the next instruction of a process only uses its registers:
+ * CALC, SET, ADD, SUB, MUL, CMP and the jumps. Nothing shared sees it,
+ * so a deterministic run lets it go out of turn, see timer_pass() */
+int private_step(struct pcb_t * proc);
+
+/* Number of consecutive CALC instructions the process is about to
+ * execute, at most [max]. 0 if the next instruction is not a CALC. */
+uint32_t calc_burst(struct pcb_t * proc, uint32_t max);
+
+/* Maximum number of simulated CPUs, including hotplugged ones */
+#define MAX_CPU 32
+
+/* CPU hotplug (implemented by the kernel in os.c). Bring CPU [id] of
+ * [krnl] online or take it offline while the simulation runs. An
+ * offlined CPU puts its running process back to the ready queue so the
+ * surviving CPUs pick it up. Return 0 on success, -1 if the request
+ * cannot be honoured. */
+int cpu_online(struct krnl_t * krnl, int id);
+int cpu_offline(struct krnl_t * krnl, int id);
+
 #endif
 
@@ -0,0 +1,45 @@
+#ifndef EVLOG_H
+#define EVLOG_H
+
+#include "common.h"
+
+/* Event log of a run, what the scheduler needs to replay it (see
+ * replay.c): the arrival and priority of every admitted process and the
+ * CPU it used. After the header, each admission is an 'A' byte followed
+ * by the pid, the arrival slot, the priority and the length of the
+ * program, each finish an 'F' byte followed by the pid and the slots it
+ * ran. Numbers are unsigned LEB128, as in code images */
+#define EVLOG_MAGIC	"OSEV"
+#define EVLOG_VERSION	1
+
+struct evlog_hdr {
+	char magic[4];
+	uint32_t version;
+	uint32_t cpus;
+	uint32_t time_slot;
+};
+
+/* A process of a log, in admission order. [demand] is the slots it ran,
+ * or the length of its program if the run ended before it */
+struct evlog_proc {
+	uint64_t arrival;
+	uint32_t priority;
+	uint64_t demand;
+};
+
+/* Record a run in [path]. NULL if it cannot be created. The calls
+ * taking a log do nothing on a NULL one, a run that is not recorded */
+struct evlog * evlog_open(const char * path, int cpus, int time_slot);
+
+void evlog_admit(struct evlog * log, const struct pcb_t * proc);
+
+void evlog_finish(struct evlog * log, const struct pcb_t * proc);
+
+void evlog_close(struct evlog * log);
+
+/* Processes of the log at [path], NULL if it cannot be read. The caller
+ * frees the array */
+struct evlog_proc * evlog_read(const char * path, struct evlog_hdr * hdr,
+		size_t * count);
+
+#endif
@@ -3,7 +3,32 @@
 
 #include "common.h"
 
+/* Create a process running the program at [path]. Processes started
+ * from the same path share one read-only copy of its code. Return NULL
+ * if the program does not pass verify() */
 struct pcb_t * load(const char * path);
 
+/* Create a process for a job of a recorded trace, without a program
+ * file: it holds [mem] bytes for [burst] slots of CPU, see encode_job() */
+struct pcb_t * load_job(uint32_t burst, unsigned long mem, uint32_t prio);
+
+/* Create a fresh process running the code of one that was started
+ * with load() or load_job(), from its proc->path */
+struct pcb_t * reload(const char * path);
+
+/* Release a finished process and its reference on the shared code */
+void unload(struct pcb_t * proc);
+
+/* While the cache is held, code no process runs any more stays loaded,
+ * so that the runs of a sweep parse each program only once. Releasing
+ * the last hold drops it */
+void code_cache_hold(void);
+void code_cache_release(void);
+
+/* Load and verify the code of a program, either a text one or a
+ * compiled one (see oscc), and its priority. NULL if rejected, left
+ * to the caller to report */
+struct code_seg_t * load_code(const char * path, uint32_t * priority);
+
 #endif
 
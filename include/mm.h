@@ -1,4 +1,5 @@
 #ifndef MM_H
+#define MM_H
 
 #include "common.h"
 #include "bitops.h"
@@ -126,6 +127,8 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
 int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value);
+int __memcpy(struct pcb_t *caller, int vmaid, int srcrgid, int dstrgid, addr_t size);
+int __memset(struct pcb_t *caller, int vmaid, int rgid, BYTE value, addr_t size);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
 
 /* VM prototypes */
@@ -154,8 +157,31 @@ int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn);
 int MEMPHY_read(struct memphy_struct * mp, addr_t addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, addr_t addr, BYTE data);
+int MEMPHY_memcpy(struct memphy_struct * mp, addr_t dst, addr_t src, addr_t len);
+int MEMPHY_memset(struct memphy_struct * mp, addr_t addr, BYTE data, addr_t len);
+
+/* MEM/PHY reduction kernels (SIMD when the host supports it) */
+#define REDUCE_SUM    0 /* Sum of the unsigned bytes */
+#define REDUCE_CSUM   1 /* 16-bit ones' complement checksum */
+#define REDUCE_MINMAX 2 /* Smallest and largest unsigned byte */
+
+struct reduce_acc {
+   addr_t pos;        /* bytes folded so far */
+   uint64_t sum;
+   uint64_t sum_even; /* bytes at even offsets, high half of a word */
+   uint64_t sum_odd;
+   uint8_t min;
+   uint8_t max;
+};
+
+int MEMPHY_reduce(struct memphy_struct * mp, addr_t addr, addr_t len, int op, struct reduce_acc *acc);
+int MEMPHY_memcmp(struct memphy_struct * mp, addr_t a, addr_t b, addr_t len, addr_t *diff);
+uint16_t reduce_checksum(struct reduce_acc *acc);
+int __reduce(struct pcb_t *caller, int vmaid, int rgid, int op, struct reduce_acc *acc);
+int __memcmp(struct pcb_t *caller, int vmaid, int rgida, int rgidb, addr_t *result);
 int MEMPHY_dump(struct memphy_struct * mp);
 int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg);
+int free_memphy(struct memphy_struct *mp);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
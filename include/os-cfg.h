@@ -45,4 +45,16 @@
 #define MM64 1
 //#undef MM64
 
+/* Loader pipeline: threads preparing processes ahead of their arrival
+ * and how many arrivals they may run ahead of the admitted ones */
+#define LOADER_WORKERS 2
+#define LOADER_AHEAD 8
+
+/* Demand-paged code: compiled programs from CODE_DEMAND_MIN bytes up
+ * are fetched CODE_CHUNK bytes at a time into a per-process window of
+ * CODE_WINDOW chunks, see code.h */
+#define CODE_DEMAND_MIN (1 << 20)
+#define CODE_CHUNK 4096
+#define CODE_WINDOW 4
+
 #endif
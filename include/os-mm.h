@@ -13,6 +13,11 @@
 
 #include <stdint.h>
 
+/* addr_t depends on MM64, whichever header comes first */
+#ifndef OSCFG_H
+#include "os-cfg.h"
+#endif
+
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
 #define PAGING_MAX_SYMTBL_SZ 30
@@ -116,6 +121,7 @@ struct memphy_struct {
    /* Basic field of data and size */
    BYTE *storage;
    int maxsz;
+   int mapped; /* storage is mmapped from a snapshot, see ckpt.h */
    
    /* Sequential device fields */ 
    int rdmflg;
@@ -0,0 +1,76 @@
+#ifndef OS_H
+#define OS_H
+
+#include "common.h"
+#include "stats.h"
+
+/* A simulation run. Every run builds its own kernel: clock, scheduler,
+ * memory, loader and CPUs, so that several runs may go on at once in
+ * one host process. They only share the programs they load, see
+ * code_cache_hold() */
+struct os_opts {
+	const char * config;	// Configure file, under input/
+	const char * stream;	// Arrival stream, "-" for stdin, or NULL
+	const char * trace;	// Recorded trace replacing the process list
+	const char * record;	// Event log to write, see evlog.h
+	const char * checkpoint;	// Snapshot to write, see ckpt.h
+	unsigned long checkpoint_at;	// Slot at the start of which it is taken
+	const char * restore;	// Snapshot to go on from instead of slot 0
+	double rate;		// Open-loop arrivals per slot, 0 for none
+	unsigned long count;	// Open-loop arrivals, 0 for the list size
+	uint64_t seed;
+	int policy;		// enum sched_policy
+	int budget;		// Slots of the top MLQ level, see init_scheduler()
+	unsigned long limit;	// Arrivals admitted at most, 0 for all
+	/* Sampling: only the first [sample_detail] slots of every
+	 * [sample_period] are simulated in detail, the CPUs fast-forward
+	 * through the others, see stats_sample(). 0 for a detailed run */
+	unsigned long sample_detail;
+	unsigned long sample_period;
+	int deterministic;	// Same input, same run, see timer_ordered()
+	/* Settings of the configure file, 0 to keep them */
+	int time_slot;
+	int cpus;
+	int memramsz;
+	int memswpsz;		// Size of the first swap device
+	FILE * out;		// Log of the run, stdout if NULL
+};
+
+/* Run the simulation described by [opts]. Return 0 on success, with
+ * the statistics of the run in [sum] if it is not NULL.
+ *
+ * A run restored from a snapshot goes on with the workload, CPUs,
+ * memory and policy of the run that wrote it: [config] may be NULL, and
+ * only [time_slot], [budget], [limit] and [out] may be given. The
+ * arrivals it admitted are read again, but not loaded */
+int os_run(const struct os_opts * opts, struct stats_summary * sum);
+
+/* Number of arrivals of the run [opts] describes, -1 if it is not
+ * known before the run, as for a trace or a stream */
+long os_workload(const struct os_opts * opts);
+
+/* Run [opts] once for every combination of the values of [axes], each
+ * one "name=value,value,...", up to [jobs] runs at a time, and print a
+ * line of statistics for each run. The names are slot, cpus, ram, swap,
+ * budget and policy. Return 0 if every run went through */
+int os_sweep(const struct os_opts * opts, char ** axes, int naxes,
+		int jobs);
+
+/* Objectives of os_tune() */
+enum tune_objective {
+	TUNE_MEAN,		// Mean turnaround, lower is better
+	TUNE_P99,		// 99th percentile of the turnaround, lower is better
+	TUNE_THROUGHPUT,	// Processes finished per slot, higher is better
+};
+
+/* Objective called [name] ("mean", "p99" or "throughput"), -1 if none */
+int tune_objective(const char * name);
+
+/* Search the settings of [axes], as given to os_sweep(), for the best
+ * [objective] on the workload of [opts], up to [jobs] runs at a time.
+ * Print the configurations that are not beaten on the objective, the
+ * CPUs and the RAM at once by another one. Return 0 on success */
+int os_tune(const struct os_opts * opts, char ** axes, int naxes,
+		int jobs, int objective);
+
+#endif
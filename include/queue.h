@@ -4,15 +4,18 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 50
-
+/* A queue grows as processes are added to it, it never drops one. A
+ * zeroed queue is empty, queue_free() releases its array */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;
 	int size;
+	int cap;
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
 
+void queue_free(struct queue_t * q);
+
 struct pcb_t * dequeue(struct queue_t * q);
 
 struct pcb_t *purgequeue(struct queue_t *q, struct pcb_t *proc);
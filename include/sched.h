@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
@@ -9,13 +9,37 @@
 
 #define MAX_PRIO 140
 
-int queue_empty(void);
+/* Scheduling policies a kernel can be started with */
+enum sched_policy {
+	SCHED_MLQ,	// A queue per priority, each served for a number of slots
+	SCHED_PRIO,	// One queue, by priority then arrival, in rounds
+};
 
-void init_scheduler(void);
-void finish_scheduler(void);
+/* Policy called [name] ("mlq" or "prio"), -1 if there is none */
+int sched_policy(const char * name);
+
+const char * sched_policy_name(enum sched_policy policy);
+
+int queue_empty(struct krnl_t * krnl);
+
+/* Give [krnl] its own ready queues, see krnl->sched. With SCHED_MLQ,
+ * [budget] is the number of slots the highest level is served for
+ * before its processes are demoted, lower levels get proportionally
+ * fewer. 0 for the default of MAX_PRIO */
+void init_scheduler(struct krnl_t * krnl, enum sched_policy policy,
+		int budget);
+void finish_scheduler(struct krnl_t * krnl);
+
+/* Snapshot of the ready queues, see ckpt.h. sched_list() adds the
+ * queued processes to [ck] for sched_save() to refer to. The queues are
+ * restored as they were saved, the budget of the kernel stays */
+struct ckpt;
+void sched_list(struct krnl_t * krnl, struct ckpt * ck);
+void sched_save(struct krnl_t * krnl, struct ckpt * ck);
+int sched_restore(struct krnl_t * krnl, struct ckpt * ck);
 
 /* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+struct pcb_t * get_proc(struct krnl_t * krnl);
 
 /* Put a process back to run queue */
 void put_proc(struct pcb_t * proc);
@@ -23,6 +47,8 @@ void put_proc(struct pcb_t * proc);
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
 
-#endif
+/* Take a finished process off the running list, before it is unloaded */
+void finish_proc(struct pcb_t * proc);
 
+#endif
 
@@ -0,0 +1,29 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/* Typed object caches for kernel structures created and destroyed with
+ * every process. Objects are carved out of cache-line aligned slabs and
+ * each thread keeps a small magazine of free objects per cache, so the
+ * common alloc/free only touches thread-local memory. The shared depot
+ * behind the magazines is only locked to refill or drain one.
+ * Objects are returned to the cache, never to the host heap. */
+
+#define SLAB_ALIGN	64	/* Object alignment, one cache line */
+#define SLAB_OBJS	64	/* Objects carved out of each slab */
+#define SLAB_MAG_SZ	16	/* Objects held by a thread magazine */
+#define SLAB_MAX_CACHES	8
+
+struct kmem_cache;
+
+/* Create a cache of [size] bytes objects. Return NULL if all the
+ * SLAB_MAX_CACHES caches are in use */
+struct kmem_cache * kmem_cache_create(const char * name, size_t size);
+
+/* Uninitialized object, NULL if out of memory */
+void * kmem_cache_alloc(struct kmem_cache * cache);
+
+void kmem_cache_free(struct kmem_cache * cache, void * obj);
+
+#endif
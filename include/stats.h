@@ -0,0 +1,85 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "common.h"
+#include <pthread.h>
+
+/* Run statistics. Turnaround times, from the slot a process is admitted
+ * in to the slot it is seen finished, go to a log-linear histogram of
+ * STATS_SUB sub-buckets per power of two, so percentiles are within
+ * 1/STATS_SUB of the exact value and memory does not grow with the
+ * number of processes */
+#define STATS_SUB	32
+#define STATS_BUCKETS	(STATS_SUB * 62)
+
+/* Processes seen finished in a detailed window of a sampled run */
+struct stats_window {
+	uint64_t finished;
+	uint64_t total;
+};
+
+/* Statistics of one run, krnl->stats */
+struct stats_t {
+	uint64_t hist[STATS_BUCKETS];
+	uint64_t admitted;
+	uint64_t finished;
+	uint64_t first_arrival;
+	uint64_t last_arrival;
+	uint64_t last_finish;
+	uint64_t total;
+	/* Sampling, see stats_sample() */
+	uint64_t detail;
+	uint64_t period;
+	uint64_t from;
+	struct stats_window * windows;
+	size_t nwindows;
+	pthread_mutex_t lock;
+};
+
+/* What stats_report() prints, for a caller to tabulate */
+struct stats_summary {
+	uint64_t admitted;
+	uint64_t finished;
+	uint64_t span;		// Slots from the first arrival to the last finish
+	double offered;		// Processes per slot
+	double throughput;
+	double mean;		// Turnaround, in slots
+	uint64_t p50, p99, p999;
+};
+
+void stats_init(struct stats_t * stats);
+
+void stats_destroy(struct stats_t * stats);
+
+/* Sample the run: the slots from [from] on are cut in periods of
+ * [period] slots, the first [detail] of which are a detailed window.
+ * The processes seen finished in each window are also counted apart */
+void stats_sample(struct stats_t * stats, uint64_t detail,
+		uint64_t period, uint64_t from);
+
+/* Slots from [time] to the next detailed window, 0 if [time] is in one
+ * or the run is not sampled */
+uint64_t stats_gap(const struct stats_t * stats, uint64_t time);
+
+void stats_arrival(struct stats_t * stats, struct pcb_t * proc,
+		uint64_t time);
+
+void stats_finish(struct stats_t * stats, const struct pcb_t * proc,
+		uint64_t time);
+
+/* [offered] is the mean arrival rate of the run, in processes per slot,
+ * 0 to take the rate the processes were admitted at */
+void stats_summary(struct stats_t * stats, double offered,
+		struct stats_summary * sum);
+
+/* Print throughput and turnaround percentiles to [out] */
+void stats_report(struct stats_t * stats, FILE * out, double offered);
+
+/* Print the throughput and mean turnaround extrapolated from the
+ * windows of a sampled run, with their 95% confidence intervals.
+ * [detailed] and [forwarded] are the instructions run in and between
+ * the windows */
+void stats_sampled(struct stats_t * stats, FILE * out, uint64_t detailed,
+		uint64_t forwarded);
+
+#endif
@@ -3,26 +3,80 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
+
+/* Clock of one kernel instance, see timer_new() */
+struct ktimer_t;
 
 struct timer_id_t {
 	int done;
 	int fsh;
+	uint64_t skip;	// Slots still to sleep through, see next_slots()
+	/* Turns, see timer_turn(). Guarded by the turn lock of the timer */
+	int order;
+	uint64_t turn;	// First slot the device has not passed
+	uint64_t joined;	// Slot it was attached in, once the clock runs
+	struct ktimer_t * timer;
 	pthread_cond_t event_cond;
 	pthread_mutex_t event_lock;
 	pthread_cond_t timer_cond;
 	pthread_mutex_t timer_lock;
 };
 
-void start_timer();
+/* Create a clock that logs each time slot to [out]. Clocks are
+ * independent, so several kernels may run side by side */
+struct ktimer_t * timer_new(FILE * out);
+
+/* Start the clock at slot [time] rather than 0, before start_timer() */
+void timer_set(struct ktimer_t * timer, uint64_t time);
+
+/* Call [fn] with [arg] at the start of slot [time], once every device
+ * is done with the slot before and before any goes on. A device asleep
+ * (see next_slots()) then has in [skip] the number of slots, this one
+ * included, it still sleeps through */
+void timer_at(struct ktimer_t * timer, uint64_t time,
+		void (*fn)(void *), void * arg);
+
+/* Deterministic mode, before start_timer(): in every slot, the time
+ * slot is logged first, then the devices take turns in the order they
+ * were attached with, see timer_turn(). A device attached while the
+ * clock runs takes its first turn after those of the others */
+void timer_ordered(struct ktimer_t * timer);
+
+/* Before start_timer(): the slots every device sleeps through (see
+ * next_slots()) pass in one step and are not logged, e.g. those fast
+ * forwarded in a sampled run */
+void timer_bulk(struct ktimer_t * timer);
 
-void stop_timer();
+/* Wait for the devices before this one to pass the current slot. All
+ * that others may observe (queues, memory, log) is done in turn. A no-op
+ * unless the timer is ordered */
+void timer_turn(struct timer_id_t * timer_id);
 
-struct timer_id_t * attach_event();
+/* Let the devices after this one take their turn, as next_slot() and
+ * detach_event() do. The device may go on with work of its own */
+void timer_pass(struct timer_id_t * timer_id);
+
+void start_timer(struct ktimer_t * timer);
+
+/* Wait for the clock to stop and release it with its devices */
+void stop_timer(struct ktimer_t * timer);
+
+/* Register a new device with the timer. This may also be called after
+ * start_timer() by a running device, the slot it is attached in then
+ * does not end before the new device is done with it too. [order]
+ * ranks it among the devices of an ordered timer */
+struct timer_id_t * attach_event(struct ktimer_t * timer, int order);
 
 void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
-uint64_t current_time();
+/* Same as calling next_slot() [n] times in a row, but the device only
+ * synchronizes with the timer once for the whole run of slots */
+void next_slots(struct timer_id_t* timer_id, uint64_t n);
+
+uint64_t current_time(const struct ktimer_t * timer);
 
 #endif
+
@@ -0,0 +1,30 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Recorded job traces, replayed without program files. A trace is
+ * either a CSV file, one job per line, or a JSON array of job objects.
+ * A job has four fields, all numbers: "arrival" (time slot), "burst"
+ * (slots of CPU), "mem" (bytes) and "prio". A CSV file names its
+ * columns in an optional header line, in any order, and its other
+ * columns are ignored. Without header, the columns are in the order
+ * above. Lines starting with '#' are comments. */
+
+struct trace_job {
+	unsigned long arrival;
+	unsigned long burst;
+	unsigned long mem;
+	unsigned long prio;
+};
+
+struct trace;
+
+/* NULL if [path] cannot be opened */
+struct trace * trace_open(const char * path);
+
+/* Read the next job. Return 0 on success, -1 at the end of the trace.
+ * Malformed records are reported and skipped */
+int trace_next(struct trace * t, struct trace_job * job);
+
+void trace_close(struct trace * t);
+
+#endif
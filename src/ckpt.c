@@ -0,0 +1,420 @@
+
+#include "ckpt.h"
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define CKPT_DEVICES	(1 + PAGING_MAX_MMSWP)
+
+#define ALIGN_UP(n)	(((n) + CKPT_ALIGN - 1) / CKPT_ALIGN * CKPT_ALIGN)
+
+/* What a snapshot must agree on with the build reading it */
+struct ckpt_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t addr_size;
+	uint32_t page_size;
+	uint32_t max_pgn;
+};
+
+struct ckpt {
+	FILE * file;
+	char * path;		/* Writing: where the file goes once complete */
+	int error;
+	struct pcb_t ** procs;
+	int nprocs;
+	int size;
+	struct memphy_struct * devs[CKPT_DEVICES];
+	int ndevs;
+};
+
+static void ckpt_hdr(struct ckpt_hdr * hdr) {
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+	hdr->version = CKPT_VERSION;
+	hdr->addr_size = sizeof(addr_t);
+	hdr->page_size = PAGING_PAGESZ;
+	hdr->max_pgn = PAGING_MAX_PGN;
+}
+
+static char * tmp_path(const char * path) {
+	char * tmp = (char *)malloc(strlen(path) + 5);
+	sprintf(tmp, "%s.tmp", path);
+	return tmp;
+}
+
+struct ckpt * ckpt_create(const char * path) {
+	struct ckpt_hdr hdr;
+	struct ckpt * ck;
+	char * tmp = tmp_path(path);
+	FILE * file;
+
+	/* A run mapping the old snapshot keeps it until it is done */
+	file = fopen(tmp, "wb");
+	free(tmp);
+	if (file == NULL)
+		return NULL;
+	ck = (struct ckpt *)calloc(1, sizeof(struct ckpt));
+	ck->file = file;
+	ck->path = strdup(path);
+	ckpt_hdr(&hdr);
+	CKPT_PUT(ck, hdr);
+	return ck;
+}
+
+struct ckpt * ckpt_open(const char * path) {
+	struct ckpt_hdr hdr, want;
+	struct ckpt * ck;
+	FILE * file;
+
+	if ((file = fopen(path, "rb")) == NULL)
+		return NULL;
+	ckpt_hdr(&want);
+	if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    memcmp(&hdr, &want, sizeof(hdr)) != 0) {
+		fclose(file);
+		return NULL;
+	}
+	ck = (struct ckpt *)calloc(1, sizeof(struct ckpt));
+	ck->file = file;
+	return ck;
+}
+
+void ckpt_put(struct ckpt * ck, const void * buf, size_t size) {
+	if (size > 0 && fwrite(buf, size, 1, ck->file) != 1)
+		ck->error = 1;
+}
+
+int ckpt_get(struct ckpt * ck, void * buf, size_t size) {
+	if (ck->error || (size > 0 && fread(buf, size, 1, ck->file) != 1)) {
+		ck->error = 1;
+		return -1;
+	}
+	return 0;
+}
+
+/* Read a list length, anything too long is an error */
+static uint32_t get_len(struct ckpt * ck) {
+	uint32_t n = 0;
+
+	if (CKPT_GET(ck, n) != 0 || n > CKPT_LIST_MAX) {
+		ck->error = 1;
+		return 0;
+	}
+	return n;
+}
+
+int ckpt_add_proc(struct ckpt * ck, struct pcb_t * proc) {
+	int i = ckpt_proc_index(ck, proc);
+
+	if (i >= 0)
+		return i;
+	if (ck->nprocs == ck->size) {
+		ck->size = ck->size ? 2 * ck->size : 64;
+		ck->procs = realloc(ck->procs, sizeof(*ck->procs) * ck->size);
+	}
+	ck->procs[ck->nprocs] = proc;
+	return ck->nprocs++;
+}
+
+int ckpt_proc_index(const struct ckpt * ck, const struct pcb_t * proc) {
+	int i;
+
+	for (i = 0; proc != NULL && i < ck->nprocs; i++) {
+		if (ck->procs[i] == proc)
+			return i;
+	}
+	return -1;
+}
+
+int ckpt_nprocs(const struct ckpt * ck) {
+	return ck->nprocs;
+}
+
+struct pcb_t * ckpt_proc(const struct ckpt * ck, int index) {
+	return index >= 0 && index < ck->nprocs ? ck->procs[index] : NULL;
+}
+
+void ckpt_put_proc(struct ckpt * ck, const struct pcb_t * proc) {
+	int32_t i = ckpt_proc_index(ck, proc);
+
+	CKPT_PUT(ck, i);
+}
+
+void ckpt_set_proc(struct ckpt * ck, int index, struct pcb_t * proc) {
+	while (ck->nprocs <= index)
+		ckpt_add_proc(ck, NULL);
+	ck->procs[index] = proc;
+}
+
+struct pcb_t * ckpt_get_proc(struct ckpt * ck) {
+	int32_t i = -1;
+
+	if (CKPT_GET(ck, i) != 0 || i < 0 || i >= ck->nprocs)
+		return NULL;
+	return ck->procs[i];
+}
+
+static void put_rg_list(struct ckpt * ck, const struct vm_rg_struct * rg) {
+	const struct vm_rg_struct * it;
+	uint32_t n = 0;
+
+	for (it = rg; it != NULL; it = it->rg_next)
+		n++;
+	CKPT_PUT(ck, n);
+	for (it = rg; it != NULL; it = it->rg_next) {
+		CKPT_PUT(ck, it->rg_start);
+		CKPT_PUT(ck, it->rg_end);
+	}
+}
+
+static struct vm_rg_struct * get_rg_list(struct ckpt * ck) {
+	struct vm_rg_struct * head = NULL;
+	struct vm_rg_struct ** tail = &head;
+	uint32_t n = get_len(ck);
+	addr_t start, end;
+
+	while (n-- > 0 && CKPT_GET(ck, start) == 0 && CKPT_GET(ck, end) == 0) {
+		struct vm_rg_struct * rg = malloc(sizeof(*rg));
+
+		rg->rg_start = start;
+		rg->rg_end = end;
+		rg->rg_next = NULL;
+		*tail = rg;
+		tail = &rg->rg_next;
+	}
+	return head;
+}
+
+void ckpt_put_mm(struct ckpt * ck, const struct mm_struct * mm) {
+	const struct vm_area_struct * vma;
+	const struct pgn_t * pg;
+	uint32_t i, n = 0;
+
+	/* Only the entries in use of the page table */
+	for (i = 0; i < PAGING_MAX_PGN; i++)
+		n += mm->pgd[i] != 0;
+	CKPT_PUT(ck, n);
+	for (i = 0; i < PAGING_MAX_PGN; i++) {
+		if (mm->pgd[i] != 0) {
+			CKPT_PUT(ck, i);
+			CKPT_PUT(ck, mm->pgd[i]);
+		}
+	}
+
+	n = 0;
+	for (vma = mm->mmap; vma != NULL; vma = vma->vm_next)
+		n++;
+	CKPT_PUT(ck, n);
+	for (vma = mm->mmap; vma != NULL; vma = vma->vm_next) {
+		CKPT_PUT(ck, vma->vm_id);
+		CKPT_PUT(ck, vma->vm_start);
+		CKPT_PUT(ck, vma->vm_end);
+		CKPT_PUT(ck, vma->sbrk);
+		put_rg_list(ck, vma->vm_freerg_list);
+	}
+
+	for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
+		CKPT_PUT(ck, mm->symrgtbl[i].rg_start);
+		CKPT_PUT(ck, mm->symrgtbl[i].rg_end);
+	}
+
+	n = 0;
+	for (pg = mm->fifo_pgn; pg != NULL; pg = pg->pg_next)
+		n++;
+	CKPT_PUT(ck, n);
+	for (pg = mm->fifo_pgn; pg != NULL; pg = pg->pg_next)
+		CKPT_PUT(ck, pg->pgn);
+}
+
+int ckpt_get_mm(struct ckpt * ck, struct mm_struct * mm) {
+	struct vm_area_struct ** vtail;
+	struct pgn_t ** ptail;
+	uint32_t i, n;
+
+	memset(mm, 0, sizeof(*mm));
+	mm->pgd = (typeof(mm->pgd))calloc(PAGING_MAX_PGN, sizeof(mm->pgd[0]));
+	n = get_len(ck);
+	while (n-- > 0 && CKPT_GET(ck, i) == 0) {
+		if (i >= PAGING_MAX_PGN) {
+			ck->error = 1;
+			break;
+		}
+		CKPT_GET(ck, mm->pgd[i]);
+	}
+
+	n = get_len(ck);
+	vtail = &mm->mmap;
+	while (n-- > 0 && !ck->error) {
+		struct vm_area_struct * vma = malloc(sizeof(*vma));
+
+		CKPT_GET(ck, vma->vm_id);
+		CKPT_GET(ck, vma->vm_start);
+		CKPT_GET(ck, vma->vm_end);
+		CKPT_GET(ck, vma->sbrk);
+		vma->vm_freerg_list = get_rg_list(ck);
+		vma->vm_mm = mm;
+		vma->vm_next = NULL;
+		*vtail = vma;
+		vtail = &vma->vm_next;
+	}
+
+	for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
+		CKPT_GET(ck, mm->symrgtbl[i].rg_start);
+		CKPT_GET(ck, mm->symrgtbl[i].rg_end);
+	}
+
+	n = get_len(ck);
+	ptail = &mm->fifo_pgn;
+	while (n-- > 0 && !ck->error) {
+		struct pgn_t * pg = malloc(sizeof(*pg));
+
+		CKPT_GET(ck, pg->pgn);
+		pg->pg_next = NULL;
+		*ptail = pg;
+		ptail = &pg->pg_next;
+	}
+	return ck->error ? -1 : 0;
+}
+
+void ckpt_free_mm(struct mm_struct * mm) {
+	struct vm_area_struct * vma;
+	struct vm_rg_struct * rg;
+	struct pgn_t * pg;
+
+	free(mm->pgd);
+	while ((vma = mm->mmap) != NULL) {
+		mm->mmap = vma->vm_next;
+		while ((rg = vma->vm_freerg_list) != NULL) {
+			vma->vm_freerg_list = rg->rg_next;
+			free(rg);
+		}
+		free(vma);
+	}
+	while ((pg = mm->fifo_pgn) != NULL) {
+		mm->fifo_pgn = pg->pg_next;
+		free(pg);
+	}
+}
+
+static void put_fp_list(struct ckpt * ck, const struct framephy_struct * fp) {
+	const struct framephy_struct * it;
+	uint32_t n = 0;
+
+	for (it = fp; it != NULL; it = it->fp_next)
+		n++;
+	CKPT_PUT(ck, n);
+	for (it = fp; it != NULL; it = it->fp_next)
+		CKPT_PUT(ck, it->fpn);
+}
+
+static struct framephy_struct * get_fp_list(struct ckpt * ck) {
+	struct framephy_struct * head = NULL;
+	struct framephy_struct ** tail = &head;
+	uint32_t n = get_len(ck);
+
+	while (n-- > 0 && !ck->error) {
+		struct framephy_struct * fp = malloc(sizeof(*fp));
+
+		CKPT_GET(ck, fp->fpn);
+		fp->fp_next = NULL;
+		fp->owner = NULL;
+		*tail = fp;
+		tail = &fp->fp_next;
+	}
+	return head;
+}
+
+void ckpt_put_memphy(struct ckpt * ck, struct memphy_struct * mp) {
+	CKPT_PUT(ck, mp->maxsz);
+	CKPT_PUT(ck, mp->rdmflg);
+	CKPT_PUT(ck, mp->cursor);
+	put_fp_list(ck, mp->free_fp_list);
+	put_fp_list(ck, mp->used_fp_list);
+	if (ck->ndevs < CKPT_DEVICES)
+		ck->devs[ck->ndevs++] = mp;
+	else
+		ck->error = 1;
+}
+
+int ckpt_get_memphy(struct ckpt * ck, struct memphy_struct * mp) {
+	memset(mp, 0, sizeof(*mp));
+	CKPT_GET(ck, mp->maxsz);
+	CKPT_GET(ck, mp->rdmflg);
+	CKPT_GET(ck, mp->cursor);
+	mp->free_fp_list = get_fp_list(ck);
+	mp->used_fp_list = get_fp_list(ck);
+	if (mp->maxsz < 0 || ck->ndevs == CKPT_DEVICES)
+		ck->error = 1;
+	else
+		ck->devs[ck->ndevs++] = mp;
+	return ck->error ? -1 : 0;
+}
+
+/* Write the storage of [mp] at [off], leaving out its pages of zeros */
+static void put_storage(struct ckpt * ck, const struct memphy_struct * mp,
+		long off) {
+	static const BYTE zero[CKPT_CHUNK];
+	long i;
+
+	for (i = 0; i < mp->maxsz && !ck->error; i += CKPT_CHUNK) {
+		long len = mp->maxsz - i < CKPT_CHUNK ? mp->maxsz - i : CKPT_CHUNK;
+
+		if (!memcmp(mp->storage + i, zero, len))
+			continue;
+		if (fseek(ck->file, off + i, SEEK_SET) != 0)
+			ck->error = 1;
+		else
+			ckpt_put(ck, mp->storage + i, len);
+	}
+}
+
+int ckpt_close(struct ckpt * ck) {
+	long off = ALIGN_UP(ftell(ck->file));
+	int ret;
+	int d;
+
+	for (d = 0; d < ck->ndevs && !ck->error; d++) {
+		struct memphy_struct * mp = ck->devs[d];
+
+		if (ck->path != NULL) {
+			put_storage(ck, mp, off);
+		}else if (mp->maxsz > 0) {
+			mp->storage = mmap(NULL, mp->maxsz, PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE, fileno(ck->file), off);
+			if (mp->storage == MAP_FAILED) {
+				mp->storage = NULL;
+				ck->error = 1;
+			}else{
+				mp->mapped = 1;
+			}
+		}
+		off = ALIGN_UP(off + mp->maxsz);
+	}
+
+	if (ck->path != NULL) {
+		char * tmp = tmp_path(ck->path);
+
+		/* The holes up to the end of the last device */
+		if (fflush(ck->file) != 0 ||
+		    ftruncate(fileno(ck->file), off) != 0)
+			ck->error = 1;
+		if (fclose(ck->file) != 0)
+			ck->error = 1;
+		if (ck->error || rename(tmp, ck->path) != 0) {
+			unlink(tmp);
+			ck->error = 1;
+		}
+		free(tmp);
+		free(ck->path);
+	}else{
+		fclose(ck->file);
+	}
+	ret = ck->error ? -1 : 0;
+	free(ck->procs);
+	free(ck);
+	return ret;
+}
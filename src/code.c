@@ -0,0 +1,619 @@
+
+#include "code.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Operand layout of each opcode */
+struct inst_fmt {
+	uint8_t nargs;	// Number of operands
+	int8_t target;	// Index of the jump target operand, -1 if none
+};
+
+static const struct inst_fmt fmt[] = {
+	[CALC]    = {0, -1},
+	[ALLOC]   = {2, -1},
+	[FREE]    = {1, -1},
+	[READ]    = {3, -1},
+	[WRITE]   = {3, -1},
+	[SYSCALL] = {4, -1},
+	[MEMCPY]  = {3, -1},
+	[MEMSET]  = {3, -1},
+	[SUM]     = {2, -1},
+	[CSUM]    = {2, -1},
+	[MIN]     = {2, -1},
+	[MAX]     = {2, -1},
+	[MEMCMP]  = {3, -1},
+	[SET]     = {2, -1},
+	[ADD]     = {3, -1},
+	[SUB]     = {3, -1},
+	[MUL]     = {3, -1},
+	[CMP]     = {3, -1},
+	[JMP]     = {1, 0},
+	[JZ]      = {2, 1},
+	[JNZ]     = {2, 1},
+};
+
+#define NUM_OPCODES	(sizeof(fmt) / sizeof(fmt[0]))
+#define TARGET_LEN	4
+
+/* Jump targets, as instruction indexes before encoding */
+static int check_targets(const struct code_seg_t *code, const struct inst_t *ins)
+{
+	switch (ins->opcode) {
+	case JMP:
+		return ins->arg_0 <= code->count;
+	case JZ:
+	case JNZ:
+		return ins->arg_1 <= code->count;
+	default:
+		return 1;
+	}
+}
+
+static arg_t get_arg(const struct inst_t *ins, int i)
+{
+	switch (i) {
+	case 0: return ins->arg_0;
+	case 1: return ins->arg_1;
+	case 2: return ins->arg_2;
+	default: return ins->arg_3;
+	}
+}
+
+static uint32_t leb_len(arg_t v)
+{
+	uint32_t len = 1;
+
+	while (v >= 0x80) {
+		v >>= 7;
+		len++;
+	}
+	return len;
+}
+
+static uint8_t * leb_put(uint8_t *p, arg_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static uint32_t inst_len(const struct inst_t *ins)
+{
+	const struct inst_fmt *f = &fmt[ins->opcode];
+	uint32_t len = 1;
+	int i;
+
+	for (i = 0; i < f->nargs; i++)
+		len += (i == f->target) ? TARGET_LEN : leb_len(get_arg(ins, i));
+	return len;
+}
+
+int encode(struct code_seg_t *code)
+{
+	uint32_t *offset;
+	uint64_t len = 0;
+	uint32_t i;
+
+	/* First pass: validate and lay out the image */
+	offset = (uint32_t *)malloc(sizeof(uint32_t) * (code->count + 1));
+	for (i = 0; i < code->count; i++) {
+		struct inst_t *ins = &code->text[i];
+
+		if ((unsigned)ins->opcode >= NUM_OPCODES ||
+		    !check_targets(code, ins) || len > UINT32_MAX) {
+			free(offset);
+			return -1;
+		}
+		offset[i] = (uint32_t)len;
+		len += inst_len(ins);
+	}
+	if (len > UINT32_MAX) {
+		free(offset);
+		return -1;
+	}
+	offset[code->count] = (uint32_t)len;
+
+	/* Second pass: emit, with jump targets resolved to offsets */
+	code->image = (uint8_t *)malloc(len ? len : 1);
+	code->size = (uint32_t)len;
+	uint8_t *p = code->image;
+	for (i = 0; i < code->count; i++) {
+		struct inst_t *ins = &code->text[i];
+		const struct inst_fmt *f = &fmt[ins->opcode];
+		int k;
+
+		*p++ = (uint8_t)ins->opcode;
+		for (k = 0; k < f->nargs; k++) {
+			if (k == f->target) {
+				uint32_t t = offset[get_arg(ins, k)];
+				p[0] = t;
+				p[1] = t >> 8;
+				p[2] = t >> 16;
+				p[3] = t >> 24;
+				p += TARGET_LEN;
+			} else {
+				p = leb_put(p, get_arg(ins, k));
+			}
+		}
+	}
+	free(offset);
+	return 0;
+}
+
+/* A job longer than a pass of its loop counts the passes down in
+ * JOB_COUNTER, by JOB_STEP. A pass is JOB_CALC calc, then the SUB and
+ * the JNZ, each one slot like a calc */
+#define JOB_CALC	60
+#define JOB_COUNTER	1
+#define JOB_STEP	2
+
+static uint32_t job_inst(struct inst_t *text, uint32_t n,
+		enum ins_opcode_t opcode, arg_t a0, arg_t a1, arg_t a2)
+{
+	text[n].opcode = opcode;
+	text[n].arg_0 = a0;
+	text[n].arg_1 = a1;
+	text[n].arg_2 = a2;
+	text[n].arg_3 = 0;
+	return n + 1;
+}
+
+int encode_job(struct code_seg_t *code, uint32_t burst, arg_t mem)
+{
+	struct inst_t text[2 * JOB_CALC + 8];
+	uint32_t n = 0, calc = burst, i;
+	int err;
+
+	if (mem > 0)
+		n = job_inst(text, n, ALLOC, mem, 0, 0);
+	if (burst >= 2 + JOB_CALC + 2) {
+		/* Two slots of setup, then whole passes, then the rest */
+		uint32_t pass = (burst - 2) / (JOB_CALC + 2);
+		uint32_t loop;
+
+		calc = (burst - 2) % (JOB_CALC + 2);
+		n = job_inst(text, n, SET, JOB_COUNTER, pass, 0);
+		n = job_inst(text, n, SET, JOB_STEP, 1, 0);
+		loop = n;
+		for (i = 0; i < JOB_CALC; i++)
+			n = job_inst(text, n, CALC, 0, 0, 0);
+		n = job_inst(text, n, SUB, JOB_COUNTER, JOB_COUNTER, JOB_STEP);
+		n = job_inst(text, n, JNZ, JOB_COUNTER, loop, 0);
+	}
+	for (i = 0; i < calc; i++)
+		n = job_inst(text, n, CALC, 0, 0, 0);
+	if (mem > 0)
+		n = job_inst(text, n, FREE, 0, 0, 0);
+
+	code->text = text;
+	code->count = n;
+	err = encode(code);
+	code->text = NULL;
+	return err;
+}
+
+struct code_window * code_window_new(const struct code_seg_t *code)
+{
+	struct code_window *win;
+
+	if (code->fd < 0)
+		return NULL;
+	win = (struct code_window *)malloc(sizeof(struct code_window));
+	memset(win->used, 0, sizeof(win->used));
+	win->tick = 0;
+	win->last = 0;
+	return win;
+}
+
+/* FNV-1a hash of a chunk read on demand */
+static uint64_t chunk_hash(const uint8_t *p, size_t n)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (n--)
+		h = (h ^ *p++) * 0x100000001b3ULL;
+	return h;
+}
+
+/* Bytes of the code at [pc], [*avail] of them are valid */
+static const uint8_t * code_at(const struct code_seg_t *code,
+		struct code_window *win, uint32_t pc, uint32_t *avail)
+{
+	uint32_t chunk = pc / CODE_CHUNK;
+	uint32_t off = pc % CODE_CHUNK;
+	int i, slot;
+
+	if (code->image != NULL) {
+		*avail = code->size - pc;
+		return code->image + pc;
+	}
+
+	slot = win->last;
+	if (win->used[slot] == 0 || win->chunk[slot] != chunk) {
+		/* Miss on the last slot, look up the others, then evict
+		 * the least recently used one */
+		slot = 0;
+		for (i = 0; i < CODE_WINDOW; i++) {
+			if (win->used[i] && win->chunk[i] == chunk) {
+				slot = i;
+				break;
+			}
+			if (win->used[i] < win->used[slot])
+				slot = i;
+		}
+		if (i == CODE_WINDOW) {
+			off_t pos = sizeof(struct code_hdr) + (off_t)chunk * CODE_CHUNK;
+			ssize_t n = pread(code->fd, win->buf[slot],
+					  sizeof(win->buf[slot]), pos);
+			uint64_t h;
+
+			if (n <= 0) {
+				printf("Cannot read code at offset %u\n", pc);
+				exit(1);
+			}
+
+			/* verify() reads every chunk first and records it,
+			 * the CPU only runs a chunk as it was verified */
+			h = chunk_hash(win->buf[slot], n);
+			if (code->sum[chunk] == 0) {
+				code->sum[chunk] = h;
+			} else if (code->sum[chunk] != h) {
+				printf("Code changed at offset %u since it was "
+				       "verified\n", pc);
+				exit(1);
+			}
+			win->chunk[slot] = chunk;
+		}
+		win->last = slot;
+	}
+	win->used[slot] = ++win->tick;
+
+	*avail = code->size - pc;
+	if (*avail > CODE_CHUNK + CODE_INST_MAX - off)
+		*avail = CODE_CHUNK + CODE_INST_MAX - off;
+	return win->buf[slot] + off;
+}
+
+uint32_t fetch(const struct code_seg_t *code, struct code_window *win,
+		uint32_t pc, struct inst_t *ins)
+{
+	uint32_t avail;
+	const uint8_t *start = code_at(code, win, pc, &avail);
+	const uint8_t *p = start;
+	const struct inst_fmt *f;
+	arg_t arg[4] = {0, 0, 0, 0};
+	int k;
+
+	ins->opcode = (enum ins_opcode_t)*p++;
+	f = &fmt[ins->opcode];
+	for (k = 0; k < f->nargs; k++) {
+		if (k == f->target) {
+			arg[k] = (arg_t)p[0] | (arg_t)p[1] << 8 |
+				 (arg_t)p[2] << 16 | (arg_t)p[3] << 24;
+			p += TARGET_LEN;
+		} else {
+			arg_t v = 0;
+			int shift = 0;
+
+			do {
+				v |= (arg_t)(*p & 0x7f) << shift;
+				shift += 7;
+			} while (*p++ & 0x80);
+			arg[k] = v;
+		}
+	}
+	ins->arg_0 = arg[0];
+	ins->arg_1 = arg[1];
+	ins->arg_2 = arg[2];
+	ins->arg_3 = arg[3];
+	return pc + (uint32_t)(p - start);
+}
+
+static const exec_t *handlers;
+
+void decode_handlers(const exec_t *exec)
+{
+	handlers = exec;
+}
+
+void decode(struct code_seg_t *code)
+{
+	struct dinst_t *dec;
+	uint32_t *at;
+	uint32_t pc, i, n = 0, run = 0;
+	struct inst_t ins;
+
+	if (code->image == NULL || handlers == NULL)
+		return;
+
+	for (pc = 0; pc < code->size; n++) {
+		pc = fetch(code, NULL, pc, &ins);
+		if (ins.arg_0 > UINT32_MAX || ins.arg_1 > UINT32_MAX ||
+		    ins.arg_2 > UINT32_MAX || ins.arg_3 > UINT32_MAX)
+			return;
+	}
+
+	/* Index of the instruction at each offset, for the jump targets */
+	dec = (struct dinst_t *)malloc((n + 1) * sizeof(struct dinst_t));
+	at = (uint32_t *)calloc(code->size + 1, sizeof(uint32_t));
+	for (pc = 0, i = 0; i < n; i++) {
+		at[pc] = i;
+		pc = fetch(code, NULL, pc, &ins);
+		dec[i].exec = handlers[ins.opcode];
+		dec[i].opcode = ins.opcode;
+		dec[i].arg_0 = ins.arg_0;
+		dec[i].arg_1 = ins.arg_1;
+		dec[i].arg_2 = ins.arg_2;
+		dec[i].arg_3 = ins.arg_3;
+	}
+	at[code->size] = n;
+	for (i = 0; i < n; i++) {
+		if (dec[i].opcode == JMP)
+			dec[i].arg_0 = at[dec[i].arg_0];
+		else if (dec[i].opcode == JZ || dec[i].opcode == JNZ)
+			dec[i].arg_1 = at[dec[i].arg_1];
+	}
+	free(at);
+
+	/* Walk back so that each calc knows the run ahead of it */
+	for (i = n; i-- > 0; ) {
+		if (dec[i].opcode == CALC)
+			dec[i].arg_0 = ++run;
+		else
+			run = 0;
+	}
+
+	free(code->image);
+	code->image = NULL;
+	code->dec = dec;
+	code->size = n;
+}
+
+uint32_t calc_run(const struct code_seg_t *code, struct code_window *win,
+		uint32_t pc, uint32_t max)
+{
+	const uint8_t *p;
+	uint32_t avail;
+	uint32_t n = 0;
+
+	if (pc >= code->size)
+		return 0;
+	p = code_at(code, win, pc, &avail);
+	if (max > avail)
+		max = avail;
+
+	/* A calc is a lone opcode byte */
+	while (n < max && p[n] == CALC)
+		n++;
+	return n;
+}
+
+int code_write(FILE *file, const struct code_seg_t *code, uint32_t priority)
+{
+	struct code_hdr hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CODE_MAGIC, sizeof(hdr.magic));
+	hdr.version = CODE_VERSION;
+	hdr.priority = priority;
+	hdr.count = code->count;
+	hdr.size = code->size;
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1)
+		return -1;
+	if (code->size && fwrite(code->image, code->size, 1, file) != 1)
+		return -1;
+	return 0;
+}
+
+/* Syscall numbers of the kernel table */
+static int syscall_valid(arg_t nr)
+{
+#define __SYSCALL(nr, sym) case nr:
+	switch (nr) {
+#include "syscalltbl.lst"
+		return 1;
+	}
+#undef __SYSCALL
+	return 0;
+}
+
+#ifdef MM_PAGING
+/* Memory instructions name regions of the symbol table */
+#define IS_RGID(v)	((v) < PAGING_MAX_SYMTBL_SZ)
+#else
+#define IS_RGID(v)	((v) < NUM_REGS)
+#endif
+#define IS_REG(v)	((v) < NUM_REGS)
+/* No ALLOC can get more than the largest MEMRAM, whose size is an int
+ * in memphy_struct */
+#define ALLOC_MAX	((arg_t)INT_MAX)
+
+/* Operands the CPU uses unchecked */
+static int check_operands(const struct inst_t *ins)
+{
+	switch (ins->opcode) {
+	case ALLOC:
+		return IS_RGID(ins->arg_1) && ins->arg_0 <= ALLOC_MAX;
+	case WRITE:
+		return IS_RGID(ins->arg_1);
+	case FREE:
+	case MEMSET:
+		return IS_RGID(ins->arg_0);
+	case READ:
+#ifdef MM_PAGING
+		return IS_RGID(ins->arg_0);
+#else
+		return IS_RGID(ins->arg_0) && IS_REG(ins->arg_2);
+#endif
+	case MEMCPY:
+		return IS_RGID(ins->arg_0) && IS_RGID(ins->arg_1);
+	case SUM:
+	case CSUM:
+	case MIN:
+	case MAX:
+		return IS_RGID(ins->arg_0) && IS_REG(ins->arg_1);
+	case MEMCMP:
+		return IS_RGID(ins->arg_0) && IS_RGID(ins->arg_1) &&
+		       IS_REG(ins->arg_2);
+	case SET:
+	case JZ:
+	case JNZ:
+		return IS_REG(ins->arg_0);
+	case ADD:
+	case SUB:
+	case MUL:
+	case CMP:
+		return IS_REG(ins->arg_0) && IS_REG(ins->arg_1) &&
+		       IS_REG(ins->arg_2);
+	case SYSCALL:
+		return syscall_valid(ins->arg_0);
+	default:
+		return 1;
+	}
+}
+
+/* fetch() with the image bounds checked. Return the offset of the
+ * following instruction, 0 if the one at [pc] is malformed */
+static uint32_t fetch_checked(const struct code_seg_t *code,
+		struct code_window *win, uint32_t pc, struct inst_t *ins)
+{
+	uint32_t avail, len = 1;
+	const uint8_t *p = code_at(code, win, pc, &avail);
+	const struct inst_fmt *f;
+	int k;
+
+	if (p[0] >= NUM_OPCODES)
+		return 0;
+	f = &fmt[p[0]];
+	for (k = 0; k < f->nargs; k++) {
+		if (k == f->target) {
+			len += TARGET_LEN;
+		} else {
+			/* At most 10 bytes hold a 64-bit number */
+			uint32_t end = len + 10;
+			while (len < avail && len < end && (p[len] & 0x80))
+				len++;
+			if (len >= avail || len >= end)
+				return 0;
+			len++;
+		}
+		if (len > avail)
+			return 0;
+	}
+	return fetch(code, win, pc, ins);
+}
+
+int verify(const struct code_seg_t *code)
+{
+	struct code_window *win = code_window_new(code);
+	uint8_t *start = (uint8_t *)calloc(code->size / 8 + 1, 1);
+	struct inst_t ins;
+	uint32_t pc, next;
+	int ret = -1;
+
+	/* First pass: operands, and where the instructions start */
+	for (pc = 0; pc < code->size; pc = next) {
+		next = fetch_checked(code, win, pc, &ins);
+		if (next == 0 || !check_operands(&ins))
+			goto out;
+		start[pc / 8] |= 1 << (pc % 8);
+	}
+
+	/* Second pass: jumps land on an instruction or at the end */
+	for (pc = 0; pc < code->size; pc = next) {
+		arg_t t;
+
+		next = fetch(code, win, pc, &ins);
+		if (ins.opcode == JMP)
+			t = ins.arg_0;
+		else if (ins.opcode == JZ || ins.opcode == JNZ)
+			t = ins.arg_1;
+		else
+			continue;
+		if (t > code->size ||
+		    (t < code->size && !(start[t / 8] & (1 << (t % 8)))))
+			goto out;
+	}
+	ret = 0;
+out:
+	free(start);
+	free(win);
+	return ret;
+}
+
+#ifdef MM_PAGING
+/* Replay the ALLOC/FREE of a program, in program order, against a model
+ * of the vma0 first-fit free list (see __alloc/__free in libmem.c) that
+ * starts as one unbounded region. The highest address reached is the
+ * heap the program needs. The replay gives up, keeping what it found so
+ * far, once the free list holds HEAP_SIM_MAX regions */
+#define HEAP_SIM_MAX	256
+
+struct heap_rg {
+	addr_t start;
+	addr_t end;
+};
+
+addr_t heap_demand(const struct code_seg_t *code)
+{
+	struct code_window *win = code_window_new(code);
+	struct heap_rg live[PAGING_MAX_SYMTBL_SZ];
+	struct heap_rg free_rg[HEAP_SIM_MAX + 1];
+	int nfree = 1;	/* free_rg[0] is the front of the list */
+	addr_t top = 0;
+	struct inst_t ins;
+	uint32_t pc;
+	int i;
+
+	memset(live, 0, sizeof(live));
+	free_rg[0].start = 0;
+	free_rg[0].end = (addr_t)-1;
+
+	for (pc = 0; pc < code->size && nfree <= HEAP_SIM_MAX; ) {
+		pc = fetch(code, win, pc, &ins);
+		if (ins.opcode == ALLOC) {
+			/* Unverified code may ask for more, see ALLOC_MAX */
+			addr_t size = ins.arg_0 < ALLOC_MAX ?
+				      ins.arg_0 : ALLOC_MAX;
+
+			for (i = 0; i < nfree; i++) {
+				if (free_rg[i].start + size <= free_rg[i].end)
+					break;
+			}
+			live[ins.arg_1].start = free_rg[i].start;
+			live[ins.arg_1].end = free_rg[i].start + size;
+			if (live[ins.arg_1].end > top)
+				top = live[ins.arg_1].end;
+			free_rg[i].start += size;
+			if (free_rg[i].start == free_rg[i].end && i < nfree - 1) {
+				memmove(&free_rg[i], &free_rg[i + 1],
+					sizeof(free_rg[0]) * (nfree - i - 1));
+				nfree--;
+			}
+		}else if (ins.opcode == FREE) {
+			struct heap_rg *rg = &live[ins.arg_0];
+
+			if (rg->start < rg->end) {
+				memmove(&free_rg[1], &free_rg[0],
+					sizeof(free_rg[0]) * nfree);
+				free_rg[0] = *rg;
+				nfree++;
+			}
+			rg->start = rg->end = 0;
+		}
+	}
+	free(win);
+	return top;
+}
+#else
+addr_t heap_demand(const struct code_seg_t *code)
+{
+	return 0;
+}
+#endif
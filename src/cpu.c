@@ -1,9 +1,11 @@
 
 #include "cpu.h"
+#include "code.h"
 #include "mem.h"
 #include "mm.h"
 #include "syscall.h"
 #include "libmem.h"
+#include <stdlib.h>
 
 int calc(struct pcb_t *proc)
 {
@@ -58,55 +60,348 @@ int write(
 	return write_mem(proc->regs[destination] + offset, proc, data);
 }
 
-int run(struct pcb_t *proc)
+int copy_data(
+	struct pcb_t *proc, // Process executing the instruction
+	uint32_t source,	// Index of source register
+	uint32_t destination, // Index of destination register
+	uint32_t size)
 {
-	/* Check if Program Counter point to the proper instruction */
-	if (proc->pc >= proc->code->size)
+	uint32_t i;
+	BYTE data;
+
+	for (i = 0; i < size; i++)
 	{
-		return 1;
+		if (read_mem(proc->regs[source] + i, proc, &data) ||
+		    write_mem(proc->regs[destination] + i, proc, data))
+			return 1;
 	}
+	return 0;
+}
 
-	struct inst_t ins = proc->code->text[proc->pc];
-	proc->pc++;
-	int stat = 1;
-switch (ins.opcode)
+int fill_data(
+	struct pcb_t *proc, // Process executing the instruction
+	uint32_t destination, // Index of destination register
+	BYTE data,		// Filled value
+	uint32_t size)
+{
+	uint32_t i;
+
+	for (i = 0; i < size; i++)
 	{
-	case CALC:
-		stat = calc(proc);
-		break;
-	case ALLOC:
-#ifdef MM_PAGING
-		stat = liballoc(proc, ins.arg_0, ins.arg_1);
-#else
-		stat = alloc(proc, ins.arg_0, ins.arg_1);
-#endif
-		break;
-	case FREE:
-#ifdef MM_PAGING
-		stat = libfree(proc, ins.arg_0);
-#else
-		stat = free_data(proc, ins.arg_0);
-#endif
-		break;
-	case READ:
+		if (write_mem(proc->regs[destination] + i, proc, data))
+			return 1;
+	}
+	return 0;
+}
+
+/* Instruction handlers, dispatched through exec[] by opcode. The
+ * memory model (paging or not) is resolved at build time. The operands
+ * come from an inst_t or a dinst_t, see step() */
+#define EXEC_ARGS	struct pcb_t *proc, arg_t arg_0, arg_t arg_1, \
+			arg_t arg_2, arg_t arg_3
+static int exec_calc(EXEC_ARGS)
+{
+	return calc(proc);
+}
+
 #ifdef MM_PAGING
-		stat = libread(proc, ins.arg_0, ins.arg_1, (uint32_t*) &ins.arg_2);
+static int exec_alloc(EXEC_ARGS)
+{
+	return liballoc(proc, arg_0, arg_1);
+}
+
+static int exec_free(EXEC_ARGS)
+{
+	return libfree(proc, arg_0);
+}
+
+static int exec_read(EXEC_ARGS)
+{
+	uint32_t data;
+	return libread(proc, arg_0, arg_1, &data);
+}
+
+static int exec_write(EXEC_ARGS)
+{
+	return libwrite(proc, arg_0, arg_1, arg_2);
+}
+
+static int exec_memcpy(EXEC_ARGS)
+{
+	return libmemcpy(proc, arg_0, arg_1, arg_2);
+}
+
+static int exec_memset(EXEC_ARGS)
+{
+	return libmemset(proc, arg_0, arg_1, arg_2);
+}
+
+static int exec_sum(EXEC_ARGS)
+{
+	return libsum(proc, arg_0, arg_1);
+}
+
+static int exec_csum(EXEC_ARGS)
+{
+	return libcsum(proc, arg_0, arg_1);
+}
+
+static int exec_min(EXEC_ARGS)
+{
+	return libmin(proc, arg_0, arg_1);
+}
+
+static int exec_max(EXEC_ARGS)
+{
+	return libmax(proc, arg_0, arg_1);
+}
+
+static int exec_memcmp(EXEC_ARGS)
+{
+	return libmemcmp(proc, arg_0, arg_1, arg_2);
+}
 #else
-		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+static int exec_alloc(EXEC_ARGS)
+{
+	return alloc(proc, arg_0, arg_1);
+}
+
+static int exec_free(EXEC_ARGS)
+{
+	return free_data(proc, arg_0);
+}
+
+static int exec_read(EXEC_ARGS)
+{
+	return read(proc, arg_0, arg_1, arg_2);
+}
+
+static int exec_write(EXEC_ARGS)
+{
+	return write(proc, arg_0, arg_1, arg_2);
+}
+
+static int exec_memcpy(EXEC_ARGS)
+{
+	return copy_data(proc, arg_0, arg_1, arg_2);
+}
+
+static int exec_memset(EXEC_ARGS)
+{
+	return fill_data(proc, arg_0, arg_1, arg_2);
+}
+
+/* Region reductions need the region sizes only known with paging */
+static int exec_sum(EXEC_ARGS)
+{
+	return 1;
+}
+
+#define exec_csum	exec_sum
+#define exec_min	exec_sum
+#define exec_max	exec_sum
+#define exec_memcmp	exec_sum
 #endif
-		break;
-	case WRITE:
+
+static int exec_syscall(EXEC_ARGS)
+{
+	return libsyscall(proc, arg_0, arg_1, arg_2, arg_3);
+}
+
+/* Register arithmetic and control flow. Operands were checked by
+ * encode(), jump targets are offsets in the image or indexes in
+ * code->dec */
+static int exec_set(EXEC_ARGS)
+{
+	proc->regs[arg_0] = arg_1;
+	return 0;
+}
+
+static int exec_add(EXEC_ARGS)
+{
+	proc->regs[arg_0] = proc->regs[arg_1] + proc->regs[arg_2];
+	return 0;
+}
+
+static int exec_sub(EXEC_ARGS)
+{
+	proc->regs[arg_0] = proc->regs[arg_1] - proc->regs[arg_2];
+	return 0;
+}
+
+static int exec_mul(EXEC_ARGS)
+{
+	proc->regs[arg_0] = proc->regs[arg_1] * proc->regs[arg_2];
+	return 0;
+}
+
+static int exec_cmp(EXEC_ARGS)
+{
+	addr_t rs = proc->regs[arg_1];
+	addr_t rt = proc->regs[arg_2];
+
+	proc->regs[arg_0] = (rs == rt) ? 0 : (rs > rt) ? 1 : (addr_t)-1;
+	return 0;
+}
+
+static int exec_jmp(EXEC_ARGS)
+{
+	proc->pc = arg_0;
+	return 0;
+}
+
+static int exec_jz(EXEC_ARGS)
+{
+	if (proc->regs[arg_0] == 0)
+		proc->pc = arg_1;
+	return 0;
+}
+
+static int exec_jnz(EXEC_ARGS)
+{
+	if (proc->regs[arg_0] != 0)
+		proc->pc = arg_1;
+	return 0;
+}
+
+static const exec_t exec[] = {
+	[CALC]    = exec_calc,
+	[ALLOC]   = exec_alloc,
+	[FREE]    = exec_free,
+	[READ]    = exec_read,
+	[WRITE]   = exec_write,
+	[SYSCALL] = exec_syscall,
+	[MEMCPY]  = exec_memcpy,
+	[MEMSET]  = exec_memset,
+	[SUM]     = exec_sum,
+	[CSUM]    = exec_csum,
+	[MIN]     = exec_min,
+	[MAX]     = exec_max,
+	[MEMCMP]  = exec_memcmp,
+	[SET]     = exec_set,
+	[ADD]     = exec_add,
+	[SUB]     = exec_sub,
+	[MUL]     = exec_mul,
+	[CMP]     = exec_cmp,
+	[JMP]     = exec_jmp,
+	[JZ]      = exec_jz,
+	[JNZ]     = exec_jnz,
+};
+
+void cpu_init(void)
+{
+	decode_handlers(exec);
+}
+
+/* Run the instruction at the Program Counter, which moves past it,
+ * unless [skip] is set for its opcode. Decoded code is run through its
+ * handler as is, the rest is fetched from its image or window */
+static inline int step(struct pcb_t *proc, const char *skip)
+{
+	const struct code_seg_t *code = proc->code;
+	struct inst_t ins;
+
+	if (code->dec != NULL)
+	{
+		const struct dinst_t *d = &code->dec[proc->pc++];
+
+		if (skip != NULL && skip[d->opcode])
+			return 0;
+		return d->exec(proc, d->arg_0, d->arg_1, d->arg_2, d->arg_3);
+	}
+	proc->pc = fetch(code, proc->win, proc->pc, &ins);
+	if (skip != NULL && skip[ins.opcode])
+		return 0;
+	return exec[ins.opcode](proc, ins.arg_0, ins.arg_1, ins.arg_2,
+				ins.arg_3);
+}
+
+int run(struct pcb_t *proc)
+{
+	/* Check if Program Counter point to the proper instruction */
+	if (proc->pc >= proc->code->size)
+	{
+		return 1;
+	}
+
+	return step(proc, NULL);
+}
+
+uint32_t run_n(struct pcb_t *proc, uint32_t n)
+{
+	uint32_t i;
+
+	/* The handler may move the Program Counter, step through it */
+	for (i = 0; i < n && proc->pc < proc->code->size; i++)
+		step(proc, NULL);
+	return i;
+}
+
+/* Instructions fast_forward() counts without running: they set no
+ * register, so the path of the process does not depend on them. Those
+ * that load a register still run, a later JZ or JNZ may branch on the
+ * value. No system call sets one. With paging, READ only dumps the
+ * byte it reads */
+static const char ff_skip[JNZ + 1] = {
 #ifdef MM_PAGING
-		stat = libwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	[READ]    = 1,
 #endif
-		break;
-	case SYSCALL:
-		stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
-		break;
-	default:
-		stat = 1;
-	}
-	return stat;
+	[WRITE]   = 1,
+	[SYSCALL] = 1,
+	[MEMCPY]  = 1,
+	[MEMSET]  = 1,
+};
+
+uint32_t fast_forward(struct pcb_t *proc, uint32_t n)
+{
+	uint32_t i;
+
+	proc->quiet = 1;
+	for (i = 0; i < n && proc->pc < proc->code->size; i++)
+		step(proc, ff_skip);
+	proc->quiet = 0;
+	return i;
+}
+
+/* Instructions that only use the registers of the process */
+static const char reg_only[JNZ + 1] = {
+	[CALC]    = 1,
+	[SET]     = 1,
+	[ADD]     = 1,
+	[SUB]     = 1,
+	[MUL]     = 1,
+	[CMP]     = 1,
+	[JMP]     = 1,
+	[JZ]      = 1,
+	[JNZ]     = 1,
+};
+
+int private_step(struct pcb_t *proc)
+{
+	const struct code_seg_t *code = proc->code;
+	struct inst_t ins;
+
+	if (proc->pc >= code->size)
+		return 0;
+	if (code->dec != NULL)
+		return reg_only[code->dec[proc->pc].opcode];
+	fetch(code, proc->win, proc->pc, &ins);
+	return reg_only[ins.opcode];
+}
+
+uint32_t calc_burst(struct pcb_t *proc, uint32_t max)
+{
+	const struct code_seg_t *code = proc->code;
+	const struct dinst_t *d;
+
+	if (code->dec == NULL)
+		return calc_run(code, proc->win, proc->pc, max);
+	if (proc->pc >= code->size)
+		return 0;
+
+	/* A decoded calc holds the length of its run, see decode() */
+	d = &code->dec[proc->pc];
+	if (d->opcode != CALC)
+		return 0;
+	return d->arg_0 < max ? d->arg_0 : max;
 }
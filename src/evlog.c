@@ -0,0 +1,135 @@
+
+#include "evlog.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct evlog {
+	FILE * file;
+	pthread_mutex_t lock;
+};
+
+static void put_num(FILE * file, uint64_t v) {
+	while (v >= 0x80) {
+		putc((int)(v | 0x80) & 0xff, file);
+		v >>= 7;
+	}
+	putc((int)v, file);
+}
+
+static int get_num(FILE * file, uint64_t * v) {
+	int shift = 0;
+	int c;
+
+	*v = 0;
+	do {
+		if ((c = getc(file)) == EOF || shift > 63)
+			return -1;
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 0;
+}
+
+struct evlog * evlog_open(const char * path, int cpus, int time_slot) {
+	struct evlog_hdr hdr;
+	struct evlog * log;
+	FILE * file;
+
+	if ((file = fopen(path, "wb")) == NULL)
+		return NULL;
+	memcpy(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic));
+	hdr.version = EVLOG_VERSION;
+	hdr.cpus = cpus;
+	hdr.time_slot = time_slot;
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1) {
+		fclose(file);
+		return NULL;
+	}
+	log = (struct evlog *)malloc(sizeof(struct evlog));
+	log->file = file;
+	pthread_mutex_init(&log->lock, NULL);
+	return log;
+}
+
+void evlog_admit(struct evlog * log, const struct pcb_t * proc) {
+	if (log == NULL)
+		return;
+	pthread_mutex_lock(&log->lock);
+	putc('A', log->file);
+	put_num(log->file, proc->pid);
+	put_num(log->file, proc->arrival);
+	put_num(log->file, proc->priority);
+	put_num(log->file, proc->code->count);
+	pthread_mutex_unlock(&log->lock);
+}
+
+void evlog_finish(struct evlog * log, const struct pcb_t * proc) {
+	if (log == NULL)
+		return;
+	pthread_mutex_lock(&log->lock);
+	putc('F', log->file);
+	put_num(log->file, proc->pid);
+	put_num(log->file, proc->cpu_time);
+	pthread_mutex_unlock(&log->lock);
+}
+
+void evlog_close(struct evlog * log) {
+	if (log == NULL)
+		return;
+	if (fclose(log->file) != 0)
+		printf("Cannot write the event log\n");
+	pthread_mutex_destroy(&log->lock);
+	free(log);
+}
+
+struct evlog_proc * evlog_read(const char * path, struct evlog_hdr * hdr,
+		size_t * count) {
+	struct evlog_proc * procs = NULL;
+	size_t n = 0, cap = 0;
+	uint64_t pid, v[3];
+	FILE * file;
+	int c;
+
+	if ((file = fopen(path, "rb")) == NULL)
+		return NULL;
+	if (fread(hdr, sizeof(*hdr), 1, file) != 1 ||
+	    memcmp(hdr->magic, EVLOG_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != EVLOG_VERSION)
+		goto bad;
+
+	/* Pids are given in admission order, from 1 */
+	while ((c = getc(file)) != EOF) {
+		if (get_num(file, &pid) != 0 || pid == 0)
+			goto bad;
+		if (c == 'A') {
+			if (get_num(file, &v[0]) || get_num(file, &v[1]) ||
+			    get_num(file, &v[2]) || pid != n + 1)
+				goto bad;
+			if (n == cap) {
+				cap = cap ? 2 * cap : 1024;
+				procs = realloc(procs, sizeof(*procs) * cap);
+			}
+			procs[n].arrival = v[0];
+			procs[n].priority = v[1];
+			procs[n].demand = v[2];
+			n++;
+		}else if (c == 'F') {
+			if (get_num(file, &v[0]) || pid > n)
+				goto bad;
+			procs[pid - 1].demand = v[0];
+		}else{
+			goto bad;
+		}
+	}
+	fclose(file);
+	*count = n;
+	return procs ? procs : malloc(sizeof(*procs));
+
+bad:
+	printf("Malformed event log %s\n", path);
+	free(procs);
+	fclose(file);
+	return NULL;
+}
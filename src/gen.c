@@ -0,0 +1,365 @@
+/*
+ * gen - synthetic workloads for large-scale scheduler and memory tests
+ *
+ *   gen [options] <name>
+ *
+ * Write the configuration input/<name>, in the format read_config()
+ * expects, and the programs it runs, input/proc/<name>_<k>. The same
+ * options and seed always give the same files.
+ *
+ *   -n <count>    processes (8)
+ *   -p <count>    distinct programs the processes are drawn from (8)
+ *   -i <count>    instructions per program (100)
+ *   -c <count>    CPUs (2)
+ *   -t <slots>    time slice (2)
+ *   -a <dist>     arrivals: uniform, poisson or burst:<size> (uniform)
+ *   -r <rate>     mean arrivals per time slot (1)
+ *   -m <mix>      instruction weights, e.g. calc=50,alloc=10,read=12
+ *                 of calc alloc free read write memcpy memset sum
+ *   -s <dist>     allocation sizes: fixed:<n>, uniform:<lo>:<hi> or
+ *                 exp:<mean> (uniform:64:1024)
+ *   -w <count>    regions a program keeps allocated at most (8)
+ *   -M <bytes>    MEMRAM size (1048576)
+ *   -W <bytes>    MEMSWP0 size (16777216)
+ *   -S <seed>     random seed (1)
+ */
+
+#include "common.h"
+#include "os-cfg.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum gen_op {
+	G_CALC, G_ALLOC, G_FREE, G_READ, G_WRITE, G_MEMCPY, G_MEMSET, G_SUM,
+	G_NUM_OPS
+};
+
+static const char * op_names[G_NUM_OPS] = {
+	"calc", "alloc", "free", "read", "write", "memcpy", "memset", "sum"
+};
+
+static unsigned mix[G_NUM_OPS] = {50, 10, 8, 12, 12, 3, 3, 2};
+
+#ifdef MM_PAGING
+#define MAX_REGIONS	PAGING_MAX_SYMTBL_SZ
+#else
+#define MAX_REGIONS	NUM_REGS
+#endif
+
+enum { SZ_FIXED, SZ_UNIFORM, SZ_EXP };
+enum { AR_UNIFORM, AR_POISSON, AR_BURST };
+
+static struct {
+	unsigned long processes;
+	unsigned long programs;
+	unsigned long length;
+	int cpus;
+	int time_slot;
+	int arrival;
+	unsigned long burst;
+	double rate;
+	int size_dist;
+	unsigned long size_a;
+	unsigned long size_b;
+	int regions;
+	unsigned long ramsz;
+	unsigned long swpsz;
+	uint64_t seed;
+} opt = {8, 8, 100, 2, 2, AR_UNIFORM, 1, 1.0, SZ_UNIFORM, 64, 1024, 8,
+	 0x100000, 0x1000000, 1};
+
+/* xorshift64*, so that a seed means the same workload on every libc */
+static uint64_t rng_state;
+
+static uint64_t rnd(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Uniform in [0, n) */
+static uint64_t rnd_below(uint64_t n) {
+	return n ? rnd() % n : 0;
+}
+
+/* Uniform in (0, 1] */
+static double rnd_unit(void) {
+	return ((rnd() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static unsigned long alloc_size(void) {
+	unsigned long sz;
+
+	switch (opt.size_dist) {
+	case SZ_FIXED:
+		sz = opt.size_a;
+		break;
+	case SZ_UNIFORM:
+		sz = opt.size_a + rnd_below(opt.size_b - opt.size_a + 1);
+		break;
+	default:
+		sz = (unsigned long)(-log(rnd_unit()) * opt.size_a);
+		break;
+	}
+	return sz ? sz : 1;
+}
+
+static enum gen_op pick_op(unsigned total) {
+	uint64_t w = rnd_below(total);
+	int op;
+
+	for (op = 0; op < G_NUM_OPS - 1; op++) {
+		if (w < mix[op])
+			break;
+		w -= mix[op];
+	}
+	return (enum gen_op)op;
+}
+
+/* One program. Memory instructions only name allocated regions and stay
+ * within them, so a generated workload runs without memory errors */
+static int gen_program(const char * path) {
+	unsigned long size[MAX_REGIONS];	// 0 if the region is free
+	int live[MAX_REGIONS];			// Allocated regions
+	int nlive = 0;
+	unsigned total = 0;
+	unsigned long i;
+	int op;
+	FILE * file;
+
+	if ((file = fopen(path, "w")) == NULL) {
+		printf("Cannot create '%s'\n", path);
+		return -1;
+	}
+	setvbuf(file, NULL, _IOFBF, 1 << 16);
+	memset(size, 0, sizeof(size));
+	for (op = 0; op < G_NUM_OPS; op++)
+		total += mix[op];
+
+	fprintf(file, "%lu %lu\n", (unsigned long)rnd_below(MAX_PRIO), opt.length);
+	for (i = 0; i < opt.length; i++) {
+		enum gen_op o = pick_op(total);
+		int a, b, k;
+
+		if (o == G_FREE && nlive == 0)
+			o = G_ALLOC;
+		else if (o == G_ALLOC && nlive == opt.regions)
+			o = G_FREE;
+		else if (o > G_FREE && nlive == 0)
+			o = G_ALLOC;
+
+		a = nlive ? live[rnd_below(nlive)] : 0;
+		b = nlive ? live[rnd_below(nlive)] : 0;
+		switch (o) {
+		case G_CALC:
+			fprintf(file, "calc\n");
+			break;
+		case G_ALLOC:
+			for (a = 0; size[a] != 0; a++)
+				;
+			size[a] = alloc_size();
+			live[nlive++] = a;
+			fprintf(file, "alloc %lu %d\n", size[a], a);
+			break;
+		case G_FREE:
+			k = rnd_below(nlive);
+			a = live[k];
+			live[k] = live[--nlive];
+			size[a] = 0;
+			fprintf(file, "free %d\n", a);
+			break;
+		case G_READ:
+			fprintf(file, "read %d %lu %lu\n", a,
+				(unsigned long)rnd_below(size[a]),
+				(unsigned long)rnd_below(NUM_REGS));
+			break;
+		case G_WRITE:
+			fprintf(file, "write %lu %d %lu\n",
+				(unsigned long)rnd_below(256), a,
+				(unsigned long)rnd_below(size[a]));
+			break;
+		case G_MEMCPY:
+			fprintf(file, "memcpy %d %d %lu\n", a, b,
+				1 + (unsigned long)rnd_below(size[a] < size[b] ?
+							    size[a] : size[b]));
+			break;
+		case G_MEMSET:
+			fprintf(file, "memset %d %lu %lu\n", a,
+				(unsigned long)rnd_below(256),
+				1 + (unsigned long)rnd_below(size[a]));
+			break;
+		default:
+			fprintf(file, "sum %d %lu\n", a,
+				(unsigned long)rnd_below(NUM_REGS));
+			break;
+		}
+	}
+	if (fclose(file) != 0) {
+		printf("Cannot write '%s'\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static int gen_config(const char * path, const char * name) {
+	double t = 0;
+	unsigned long i;
+	FILE * file;
+
+	if ((file = fopen(path, "w")) == NULL) {
+		printf("Cannot create '%s'\n", path);
+		return -1;
+	}
+	setvbuf(file, NULL, _IOFBF, 1 << 16);
+	fprintf(file, "%d %d %lu\n", opt.time_slot, opt.cpus, opt.processes);
+#if defined(MM_PAGING) && !defined(MM_FIXED_MEMSZ)
+	fprintf(file, "%lu %lu 0 0 0\n", opt.ramsz, opt.swpsz);
+#endif
+	for (i = 0; i < opt.processes; i++) {
+		switch (opt.arrival) {
+		case AR_UNIFORM:
+			t = i / opt.rate;
+			break;
+		case AR_POISSON:
+			if (i > 0)
+				t += -log(rnd_unit()) / opt.rate;
+			break;
+		default:
+			t = (i / opt.burst) * opt.burst / opt.rate;
+			break;
+		}
+		fprintf(file, "%lu %s_%lu", (unsigned long)t, name,
+			(unsigned long)rnd_below(opt.programs));
+#ifdef MLQ_SCHED
+		fprintf(file, " %lu", (unsigned long)rnd_below(MAX_PRIO));
+#endif
+		fprintf(file, "\n");
+	}
+	if (fclose(file) != 0) {
+		printf("Cannot write '%s'\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static int parse_mix(char * s) {
+	char * item;
+
+	memset(mix, 0, sizeof(mix));
+	for (item = strtok(s, ","); item != NULL; item = strtok(NULL, ",")) {
+		char * eq = strchr(item, '=');
+		int op;
+
+		if (eq == NULL)
+			return -1;
+		*eq = '\0';
+		for (op = 0; op < G_NUM_OPS; op++) {
+			if (!strcmp(item, op_names[op]))
+				break;
+		}
+		if (op == G_NUM_OPS)
+			return -1;
+		mix[op] = strtoul(eq + 1, NULL, 10);
+	}
+	/* Memory instructions need something to allocate their regions */
+	if (mix[G_ALLOC] == 0) {
+		int op;
+
+		for (op = G_READ; op < G_NUM_OPS; op++)
+			if (mix[op])
+				return -1;
+	}
+	return 0;
+}
+
+static int parse_size(const char * s) {
+	if (sscanf(s, "fixed:%lu", &opt.size_a) == 1) {
+		opt.size_dist = SZ_FIXED;
+		return opt.size_a ? 0 : -1;
+	}
+	if (sscanf(s, "uniform:%lu:%lu", &opt.size_a, &opt.size_b) == 2) {
+		opt.size_dist = SZ_UNIFORM;
+		return opt.size_a && opt.size_a <= opt.size_b ? 0 : -1;
+	}
+	if (sscanf(s, "exp:%lu", &opt.size_a) == 1) {
+		opt.size_dist = SZ_EXP;
+		return opt.size_a ? 0 : -1;
+	}
+	return -1;
+}
+
+static int parse_arrival(const char * s) {
+	if (!strcmp(s, "uniform"))
+		opt.arrival = AR_UNIFORM;
+	else if (!strcmp(s, "poisson"))
+		opt.arrival = AR_POISSON;
+	else if (sscanf(s, "burst:%lu", &opt.burst) == 1 && opt.burst > 0)
+		opt.arrival = AR_BURST;
+	else
+		return -1;
+	return 0;
+}
+
+static void usage(void) {
+	printf("Usage: gen [-n processes] [-p programs] [-i instructions]"
+	       " [-c cpus] [-t slice]\n"
+	       "           [-a uniform|poisson|burst:<size>] [-r rate]"
+	       " [-m op=weight,...]\n"
+	       "           [-s fixed:<n>|uniform:<lo>:<hi>|exp:<mean>]"
+	       " [-w regions]\n"
+	       "           [-M ram] [-W swap] [-S seed] <name>\n");
+}
+
+int main(int argc, char * argv[]) {
+	char path[256];
+	unsigned long k;
+	int c, bad = 0;
+
+	while ((c = getopt(argc, argv, "n:p:i:c:t:a:r:m:s:w:M:W:S:")) != -1) {
+		switch (c) {
+		case 'n': opt.processes = strtoul(optarg, NULL, 10); break;
+		case 'p': opt.programs = strtoul(optarg, NULL, 10); break;
+		case 'i': opt.length = strtoul(optarg, NULL, 10); break;
+		case 'c': opt.cpus = atoi(optarg); break;
+		case 't': opt.time_slot = atoi(optarg); break;
+		case 'a': bad |= parse_arrival(optarg); break;
+		case 'r': opt.rate = atof(optarg); break;
+		case 'm': bad |= parse_mix(optarg); break;
+		case 's': bad |= parse_size(optarg); break;
+		case 'w': opt.regions = atoi(optarg); break;
+		case 'M': opt.ramsz = strtoul(optarg, NULL, 10); break;
+		case 'W': opt.swpsz = strtoul(optarg, NULL, 10); break;
+		case 'S': opt.seed = strtoull(optarg, NULL, 10); break;
+		default: bad = 1; break;
+		}
+	}
+	if (bad || optind != argc - 1 || opt.programs == 0 || opt.rate <= 0 ||
+	    opt.cpus < 1 || opt.time_slot < 1 ||
+	    opt.regions < 1 || opt.regions > MAX_REGIONS) {
+		usage();
+		return 1;
+	}
+	const char * name = argv[optind];
+	/* read_config() prefixes "input/proc/" within 100 bytes */
+	if (strlen(name) + 32 > 100) {
+		printf("Name '%s' is too long\n", name);
+		return 1;
+	}
+	rng_state = opt.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+	for (k = 0; k < opt.programs; k++) {
+		snprintf(path, sizeof(path), "input/proc/%s_%lu", name, k);
+		if (gen_program(path) != 0)
+			return 1;
+	}
+	snprintf(path, sizeof(path), "input/%s", name);
+	if (gen_config(path, name) != 0)
+		return 1;
+	printf("%s: %lu processes of %lu programs, %lu instructions each\n",
+	       path, opt.processes, opt.programs, opt.length);
+	return 0;
+}
@@ -47,13 +47,13 @@ Các thư viện (Headers) liên quan
 
 5. <stdio.h>: Dùng cho printf (chủ yếu cho các lệnh IODUMP và PAGETBL_DUMP).
 
-6. <pthread.h>: Rất quan trọng, dùng để tạo và quản lý pthread_mutex_t mmvm_lock, đảm bảo an toàn cho các thao tác bộ nhớ.
+6. <pthread.h>: Rất quan trọng, dùng cho pthread_mutex_t mmvm_lock của kernel (krnl->mmvm_lock), đảm bảo an toàn cho các thao tác bộ nhớ.
 
 
 Biến và Cấu trúc dữ liệu chính
-static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
+caller->krnl->mmvm_lock (khai báo trong struct krnl_t, common.h)
 
-Đây là một "ổ khóa" (mutex). Bất kỳ hàm nào muốn thay đổi các cấu trúc dữ liệu quản lý bộ nhớ (như vm_freerg_list hoặc symrgtbl) đều phải "khóa" (pthread_mutex_lock) trước khi bắt đầu và "mở khóa" (pthread_mutex_unlock) ngay sau khi hoàn thành.
+Đây là một "ổ khóa" (mutex), mỗi kernel có một cái riêng. Bất kỳ hàm nào muốn thay đổi các cấu trúc dữ liệu quản lý bộ nhớ (như vm_freerg_list hoặc symrgtbl) đều phải "khóa" (pthread_mutex_lock) trước khi bắt đầu và "mở khóa" (pthread_mutex_unlock) ngay sau khi hoàn thành.
 
 Điều này ngăn ngừa tình trạng "race condition" (khi 2 tiến trình cùng lúc alloc hoặc free, làm hỏng danh sách liên kết).
 
@@ -68,8 +68,25 @@ static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <stdarg.h>
 
-static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
+#ifdef IODUMP
+/*iodump - IODUMP and PAGETBL_DUMP lines of a process
+ *@proc: process executing the instruction
+ *
+ * Left out while the process is fast-forwarded, see fast_forward()
+ */
+static void iodump(struct pcb_t *proc, const char *fmt, ...)
+{
+  va_list ap;
+
+  if (proc->quiet)
+    return;
+  va_start(ap, fmt);
+  vfprintf(proc->krnl->out, fmt, ap);
+  va_end(ap);
+}
+#endif
 
 /*enlist_vm_freerg_list - add new rg to freerg_list
  *@mm: memory region
@@ -132,6 +149,25 @@ struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid)
   return &mm->symrgtbl[rgid];
 }
 
+/*caller_symrg - get mem region of the caller by region ID
+ *@caller: caller
+ *@rgid: region ID act as symbol index of variable
+ *
+ * A process running verified code only names regions in range (see
+ * verify() in code.c) and runs once its memory is set up, so it takes
+ * the lookup unchecked. Any other caller is checked as before
+ */
+static inline struct vm_rg_struct *caller_symrg(struct pcb_t *caller, int rgid)
+{
+  if (caller != NULL && caller->code != NULL && caller->code->verified)
+    return &caller->krnl->mm->symrgtbl[rgid];
+
+  if (!caller || !caller->krnl || !caller->krnl->mm ||
+      !caller->krnl->mm->mmap || !caller->krnl->mram)
+    return NULL;
+  return get_symrg_byid(caller->krnl->mm, rgid);
+}
+
 /*__alloc - allocate a region memory
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -146,7 +182,7 @@ Chức năng: Cấp phát một vùng nhớ ảo kích thước size và đăng
 
 Chi tiết code:
 
-1. pthread_mutex_lock(&mmvm_lock);: Khóa lại để bảo vệ.
+1. pthread_mutex_lock(&caller->krnl->mmvm_lock);: Khóa lại để bảo vệ.
 
 2. struct vm_area_struct *cur_vma = get_vma_by_num(...): Lấy VMA 0 (heap).
 
@@ -188,18 +224,18 @@ caller->krnl->mm->symrgtbl[rgid].rg_end = old_sbrk + size;: Địa chỉ kết t
 
 *alloc_addr = old_sbrk;.
 
-5. pthread_mutex_unlock(&mmvm_lock);: Mở khóa và return 0.
+5. pthread_mutex_unlock(&caller->krnl->mmvm_lock);: Mở khóa và return 0.
 */
 int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *alloc_addr)
 {
   /*Allocate at the toproof */
-  pthread_mutex_lock(&mmvm_lock);
 
   /*  guard NULL để tránh segfault sớm */
-  if (!caller || !caller->krnl || !caller->krnl->mm || !caller->krnl->mm->mmap) {
-    pthread_mutex_unlock(&mmvm_lock);
+  struct vm_rg_struct *symrg = caller_symrg(caller, rgid);
+  if (symrg == NULL) {
     return -1;
   }
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
   
 
   struct vm_rg_struct rgnode;
@@ -208,12 +244,12 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
 
   if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0) //int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg); mm.h
   {
-    caller->krnl->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-    caller->krnl->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
+    symrg->rg_start = rgnode.rg_start;
+    symrg->rg_end = rgnode.rg_end;
  
     *alloc_addr = rgnode.rg_start;
 
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
     return 0;
   }
 
@@ -248,12 +284,12 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
 
 
   /*Successful increase limit */
-  caller->krnl->mm->symrgtbl[rgid].rg_start = old_sbrk;
-  caller->krnl->mm->symrgtbl[rgid].rg_end = old_sbrk + size;
+  symrg->rg_start = old_sbrk;
+  symrg->rg_end = old_sbrk + size;
 
   *alloc_addr = old_sbrk;
 
-  pthread_mutex_unlock(&mmvm_lock);
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
   return 0;
 
 }
@@ -271,7 +307,7 @@ Chức năng: Trả một vùng nhớ (rgid) về danh sách free (vm_freerg_lis
 
 Chi tiết code:
 
-pthread_mutex_lock(&mmvm_lock);: Khóa.
+pthread_mutex_lock(&caller->krnl->mmvm_lock);: Khóa.
 
 struct vm_rg_struct *rgnode = get_symrg_byid(...): Lấy thông tin vùng đang cấp phát từ symrgtbl.
 
@@ -283,31 +319,22 @@ rgnode->rg_start = rgnode->rg_end = 0;: Xóa thông tin trong symrgtbl. Điều
 
 enlist_vm_freerg_list(caller->krnl->mm, freerg_node);: Đưa freerg_node vừa tạo vào đầu danh sách free.
 
-pthread_mutex_unlock(&mmvm_lock);: Mở khóa.
+pthread_mutex_unlock(&caller->krnl->mmvm_lock);: Mở khóa.
 */
 int __free(struct pcb_t *caller, int vmaid, int rgid)
 {
-  pthread_mutex_lock(&mmvm_lock);
 
   
-  if (!caller || !caller->krnl || !caller->krnl->mm) {
-    pthread_mutex_unlock(&mmvm_lock);
-    return -1;
-  }
-  
-
-  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ) /*đồng bộ điều kiện với get_symrg_byid */
-  {
-    pthread_mutex_unlock(&mmvm_lock);
+  /* TODO: Manage the collect freed region to freerg_list */
+  struct vm_rg_struct *rgnode = caller_symrg(caller, rgid);
+  if (!rgnode) {
     return -1;
   }
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
 
-  /* TODO: Manage the collect freed region to freerg_list */
-  struct vm_rg_struct *rgnode = get_symrg_byid(caller->krnl->mm, rgid);
-
-  if (!rgnode || (rgnode->rg_start == 0 && rgnode->rg_end == 0)) /*an toàn hơn */
+  if (rgnode->rg_start == 0 && rgnode->rg_end == 0) /*an toàn hơn */
   {
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
     return -1;
   }
   struct vm_rg_struct *freerg_node = malloc(sizeof(struct vm_rg_struct));
@@ -321,7 +348,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
   /*enlist the obsoleted memory region */
   enlist_vm_freerg_list(caller->krnl->mm, freerg_node);
 
-  pthread_mutex_unlock(&mmvm_lock);
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
   return 0;
 }
 
@@ -348,10 +375,10 @@ int liballoc(struct pcb_t *proc, addr_t size, uint32_t reg_index)
   }
 #ifdef IODUMP
   /* TODO dump IO content (if needed) */
-  printf("IODUMP: PID %d ALLOC vaddr=" FORMAT_ADDR " size=%llu\n",
+  iodump(proc, "IODUMP: PID %d ALLOC vaddr=" FORMAT_ADDR " size=%llu\n",
          proc->pid, addr, (unsigned long long)size);
 #ifdef PAGETBL_DUMP
-  printf("PAGETBL_DUMP: PID %d ALLOC region [rgid=%d] [" FORMAT_ADDR " -> " FORMAT_ADDR "]\n",
+  iodump(proc, "PAGETBL_DUMP: PID %d ALLOC region [rgid=%d] [" FORMAT_ADDR " -> " FORMAT_ADDR "]\n",
          proc->pid, reg_index, addr, addr + size);
 #endif
 #endif
@@ -373,17 +400,16 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
   {
     return -1;
   }
-printf("%s:%d\n",__func__,__LINE__);
 #ifdef IODUMP
   /* TODO dump IO content (if needed) */
   struct vm_rg_struct *rg = (proc && proc->krnl && proc->krnl->mm)
                             ? get_symrg_byid(proc->krnl->mm, reg_index) : NULL; /* === ĐÃ THÊM === guard */
   if (rg && rg->rg_start < rg->rg_end) {
-    printf("IODUMP: PID %d FREE vaddr=" FORMAT_ADDR " size=%llu\n",
+    iodump(proc, "IODUMP: PID %d FREE vaddr=" FORMAT_ADDR " size=%llu\n",
            proc->pid, rg->rg_start, (unsigned long long)(rg->rg_end - rg->rg_start));
   }
 #ifdef PAGETBL_DUMP
-  printf("PAGETBL_DUMP: PID %d FREE region [rgid=%d]\n", proc->pid, reg_index);
+  iodump(proc, "PAGETBL_DUMP: PID %d FREE region [rgid=%d]\n", proc->pid, reg_index);
 #endif
 #endif
   return 0;//val;
@@ -521,6 +547,27 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
   return 0;
 }
 
+/*pg_getphy - MEMRAM address of a virtual address
+ *@caller: caller
+ *@vaddr: virtual address to acess
+ *@phyaddr: return physical address
+ *
+ * The page is brought to MEMRAM if needed, as for pg_getval(). The
+ * address stays valid up to the end of its page
+ */
+static int pg_getphy(struct pcb_t *caller, addr_t vaddr, addr_t *phyaddr)
+{
+  int fpn;
+
+  if (pg_getpage(caller->krnl->mm, PAGING_PGN(vaddr), &fpn, caller) != 0)
+    return -1; /* invalid page access */
+  *phyaddr = (addr_t)fpn * PAGING_PAGESZ + PAGING_OFFST(vaddr);
+  /* A frame past the end of MEMRAM fails the access */
+  if (*phyaddr >= caller->krnl->mram->maxsz)
+    return -1;
+  return 0;
+}
+
 /*__read - read value in region memory
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -557,11 +604,7 @@ MEMPHY_read(...) hoặc MEMPHY_write(...): Gọi hàm cấp thấp để đọc/
 */
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data)
 {
-  /* guard NULL an toàn */
-  if (!caller || !caller->krnl || !caller->krnl->mm) return -1;
-  
-
-  struct vm_rg_struct *currg = get_symrg_byid(caller->krnl->mm, rgid);
+  struct vm_rg_struct *currg = caller_symrg(caller, rgid);
 
 //  struct vm_area_struct *cur_vma = get_vma_by_num(caller->krnl->mm, vmaid);
 
@@ -569,15 +612,10 @@ int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data)
   if (currg == NULL || offset >= (currg->rg_end - currg->rg_start))
     return -1;
 
-  /* guard mram NULL */
-  if (!caller->krnl->mram) return -1;
- 
-
-  addr_t vaddr = currg->rg_start + offset;
-  addr_t fpn = vaddr / PAGING_PAGESZ;
-  addr_t off = vaddr % PAGING_PAGESZ;
+  addr_t phyaddr;
 
-  if (MEMPHY_read(caller->krnl->mram, fpn * PAGING_PAGESZ + off, data) != 0)
+  if (pg_getphy(caller, currg->rg_start + offset, &phyaddr) != 0 ||
+      MEMPHY_read(caller->krnl->mram, phyaddr, data) != 0)
     return -1;
 
   return 0;
@@ -590,7 +628,7 @@ int libread(
     addr_t offset,    // Source address = [source] + [offset]
     uint32_t* destination)
 {
-  BYTE data;
+  BYTE data = 0; /* Read as 0 if the access fails */
   int val = __read(proc, 0, source, offset, &data);
 
   *destination = data;
@@ -602,11 +640,11 @@ int libread(
     addr_t vaddr = rg->rg_start + offset;
     addr_t fpn = vaddr / PAGING_PAGESZ;
     addr_t off = vaddr % PAGING_PAGESZ;
-    printf("IODUMP: PID %d READ  vaddr=" FORMAT_ADDR " fpn=%llu offset=%llu value=0x%02x\n",
+    iodump(proc, "IODUMP: PID %d READ  vaddr=" FORMAT_ADDR " fpn=%llu offset=%llu value=0x%02x\n",
            proc->pid, vaddr, (unsigned long long)fpn, (unsigned long long)off, data);
   }
 #ifdef PAGETBL_DUMP
- printf("PAGETBL_DUMP: PID %d READ  rgid=%d offset=%llu (NO PAGE TABLE)\n",
+ iodump(proc, "PAGETBL_DUMP: PID %d READ  rgid=%d offset=%llu (NO PAGE TABLE)\n",
          proc->pid, source, (unsigned long long)offset);
 #endif
 #endif
@@ -624,39 +662,27 @@ int libread(
  */
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value)
 {
-  pthread_mutex_lock(&mmvm_lock);
-
-  /* guard NULL an toàn */
-  if (!caller || !caller->krnl || !caller->krnl->mm) {
-    pthread_mutex_unlock(&mmvm_lock);
-    return -1;
-  }
-  
 
-  struct vm_rg_struct *currg = get_symrg_byid(caller->krnl->mm, rgid);
-
-  if (currg == NULL || offset >= (currg->rg_end - currg->rg_start)){
-    pthread_mutex_unlock(&mmvm_lock);
+  struct vm_rg_struct *currg = caller_symrg(caller, rgid);
+  if (currg == NULL) {
     return -1;
   }
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
 
-  /* guard mram NULL */
-  if (!caller->krnl->mram) {
-    pthread_mutex_unlock(&mmvm_lock);
+  if (offset >= (currg->rg_end - currg->rg_start)){
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
     return -1;
   }
-  
 
-  addr_t vaddr = currg->rg_start + offset;
-  addr_t fpn = vaddr / PAGING_PAGESZ;
-  addr_t off = vaddr % PAGING_PAGESZ;
+  addr_t phyaddr;
 
-  if (MEMPHY_write(caller->krnl->mram, fpn * PAGING_PAGESZ + off, value) != 0){
-    pthread_mutex_unlock(&mmvm_lock);
+  if (pg_getphy(caller, currg->rg_start + offset, &phyaddr) != 0 ||
+      MEMPHY_write(caller->krnl->mram, phyaddr, value) != 0){
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
     return -1;
   }
 
-  pthread_mutex_unlock(&mmvm_lock);
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
   return 0;
 }
 
@@ -680,17 +706,343 @@ int libwrite(
     addr_t vaddr = rg->rg_start + offset;
     addr_t fpn = vaddr / PAGING_PAGESZ;
     addr_t off = vaddr % PAGING_PAGESZ;
-    printf("IODUMP: PID %d WRITE vaddr=" FORMAT_ADDR " fpn=%llu offset=%llu value=0x%02x\n",
+    iodump(proc, "IODUMP: PID %d WRITE vaddr=" FORMAT_ADDR " fpn=%llu offset=%llu value=0x%02x\n",
            proc->pid, vaddr, (unsigned long long)fpn, (unsigned long long)off, data);
   }
 #endif
-  printf("PAGETBL_DUMP: PID %d WRITE rgid=%d offset=%llu (NO PAGE TABLE)\n",
+  iodump(proc, "PAGETBL_DUMP: PID %d WRITE rgid=%d offset=%llu (NO PAGE TABLE)\n",
          proc->pid, destination, (unsigned long long)offset);
 #endif
 
   return val;
 }
 
+/*__memcpy - copy a block between two region memory, page by page
+ *@caller: caller
+ *@vmaid: ID vm area to alloc memory region
+ *@srcrgid: source memory region ID
+ *@dstrgid: destination memory region ID
+ *@size: number of bytes, from the start of both regions
+ *
+ */
+int __memcpy(struct pcb_t *caller, int vmaid, int srcrgid, int dstrgid, addr_t size)
+{
+
+  struct vm_rg_struct *srcrg = caller_symrg(caller, srcrgid);
+  struct vm_rg_struct *dstrg = caller_symrg(caller, dstrgid);
+
+  if (srcrg == NULL || dstrg == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
+
+  if (size > (srcrg->rg_end - srcrg->rg_start) ||
+      size > (dstrg->rg_end - dstrg->rg_start)) {
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+    return -1;
+  }
+
+  addr_t done = 0;
+  while (done < size)
+  {
+    addr_t srcaddr = srcrg->rg_start + done;
+    addr_t dstaddr = dstrg->rg_start + done;
+    addr_t srcoff = srcaddr % PAGING_PAGESZ;
+    addr_t dstoff = dstaddr % PAGING_PAGESZ;
+
+    /* Stop the chunk at whichever page boundary comes first */
+    addr_t chunk = PAGING_PAGESZ - (srcoff > dstoff ? srcoff : dstoff);
+    if (chunk > size - done)
+      chunk = size - done;
+
+    /* The chunk lies within one page on both sides, each is
+     * translated on its own */
+    addr_t srcphy, dstphy;
+    if (pg_getphy(caller, srcaddr, &srcphy) != 0 ||
+        pg_getphy(caller, dstaddr, &dstphy) != 0 ||
+        MEMPHY_memcpy(caller->krnl->mram, dstphy, srcphy, chunk) != 0) {
+      pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+      return -1;
+    }
+    done += chunk;
+  }
+
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+  return 0;
+}
+
+/*libmemcpy - PAGING-based copy between two region memory */
+int libmemcpy(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint32_t source,      // Index of source region
+    uint32_t destination, // Index of destination region
+    addr_t size)
+{
+  int val = __memcpy(proc, 0, source, destination, size);
+  if (val == -1)
+  {
+    return -1;
+  }
+#ifdef IODUMP
+  iodump(proc, "IODUMP: PID %d MEMCPY rgid=%d -> rgid=%d size=%llu\n",
+         proc->pid, source, destination, (unsigned long long)size);
+#endif
+
+  return val;
+}
+
+/*__memset - fill a block of region memory, page by page
+ *@caller: caller
+ *@vmaid: ID vm area to alloc memory region
+ *@rgid: memory region ID
+ *@value: filled value
+ *@size: number of bytes, from the start of the region
+ *
+ */
+int __memset(struct pcb_t *caller, int vmaid, int rgid, BYTE value, addr_t size)
+{
+
+  struct vm_rg_struct *currg = caller_symrg(caller, rgid);
+
+  if (currg == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
+
+  if (size > (currg->rg_end - currg->rg_start)) {
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+    return -1;
+  }
+
+  addr_t done = 0;
+  while (done < size)
+  {
+    addr_t vaddr = currg->rg_start + done;
+    addr_t off = vaddr % PAGING_PAGESZ;
+    addr_t chunk = PAGING_PAGESZ - off;
+    if (chunk > size - done)
+      chunk = size - done;
+
+    addr_t phyaddr;
+    if (pg_getphy(caller, vaddr, &phyaddr) != 0 ||
+        MEMPHY_memset(caller->krnl->mram, phyaddr, value, chunk) != 0) {
+      pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+      return -1;
+    }
+    done += chunk;
+  }
+
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+  return 0;
+}
+
+/*libmemset - PAGING-based fill of a region memory */
+int libmemset(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint32_t destination, // Index of destination region
+    BYTE value,           // Filled value
+    addr_t size)
+{
+  int val = __memset(proc, 0, destination, value, size);
+  if (val == -1)
+  {
+    return -1;
+  }
+#ifdef IODUMP
+  iodump(proc, "IODUMP: PID %d MEMSET rgid=%d size=%llu value=0x%02x\n",
+         proc->pid, destination, (unsigned long long)size, (unsigned char)value);
+#endif
+
+  return val;
+}
+
+/*__reduce - fold a whole region memory, page by page
+ *@caller: caller
+ *@vmaid: ID vm area to alloc memory region
+ *@rgid: memory region ID (used to identify variable in symbole table)
+ *@op: REDUCE_SUM, REDUCE_CSUM or REDUCE_MINMAX
+ *@acc: reduction result
+ *
+ */
+int __reduce(struct pcb_t *caller, int vmaid, int rgid, int op, struct reduce_acc *acc)
+{
+
+  struct vm_rg_struct *currg = caller_symrg(caller, rgid);
+
+  if (currg == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
+
+  if (currg->rg_start >= currg->rg_end) {
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+    return -1;
+  }
+
+  memset(acc, 0, sizeof(struct reduce_acc));
+  acc->min = 0xff;
+
+  addr_t size = currg->rg_end - currg->rg_start;
+  addr_t done = 0;
+  while (done < size)
+  {
+    addr_t vaddr = currg->rg_start + done;
+    addr_t off = vaddr % PAGING_PAGESZ;
+    addr_t chunk = PAGING_PAGESZ - off;
+    if (chunk > size - done)
+      chunk = size - done;
+
+    addr_t phyaddr;
+    if (pg_getphy(caller, vaddr, &phyaddr) != 0 ||
+        MEMPHY_reduce(caller->krnl->mram, phyaddr, chunk, op, acc) != 0) {
+      pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+      return -1;
+    }
+    done += chunk;
+  }
+
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+  return 0;
+}
+
+/*__memcmp - compare two region memory, page by page
+ *@caller: caller
+ *@vmaid: ID vm area to alloc memory region
+ *@rgida: first memory region ID
+ *@rgidb: second memory region ID
+ *@result: 0 if both regions hold the same bytes, otherwise
+ *         1 + offset of the first differing byte
+ *
+ */
+int __memcmp(struct pcb_t *caller, int vmaid, int rgida, int rgidb, addr_t *result)
+{
+
+  struct vm_rg_struct *rga = caller_symrg(caller, rgida);
+  struct vm_rg_struct *rgb = caller_symrg(caller, rgidb);
+
+  if (rga == NULL || rgb == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
+
+  addr_t sza = rga->rg_end - rga->rg_start;
+  addr_t szb = rgb->rg_end - rgb->rg_start;
+  addr_t size = (sza < szb) ? sza : szb;
+  addr_t done = 0;
+
+  *result = 0;
+  while (done < size)
+  {
+    addr_t aaddr = rga->rg_start + done;
+    addr_t baddr = rgb->rg_start + done;
+    addr_t aoff = aaddr % PAGING_PAGESZ;
+    addr_t boff = baddr % PAGING_PAGESZ;
+    addr_t diff;
+
+    addr_t chunk = PAGING_PAGESZ - (aoff > boff ? aoff : boff);
+    if (chunk > size - done)
+      chunk = size - done;
+
+    addr_t aphy, bphy;
+    if (pg_getphy(caller, aaddr, &aphy) != 0 ||
+        pg_getphy(caller, baddr, &bphy) != 0 ||
+        MEMPHY_memcmp(caller->krnl->mram, aphy, bphy, chunk, &diff) != 0) {
+      pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+      return -1;
+    }
+    if (diff < chunk) {
+      *result = done + diff + 1;
+      break;
+    }
+    done += chunk;
+  }
+
+  /* Same prefix but different sizes */
+  if (*result == 0 && sza != szb)
+    *result = size + 1;
+
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
+  return 0;
+}
+
+/*libreduce - PAGING-based reduction of a region memory into a register
+ *@proc: Process executing the instruction
+ *@source: Index of the reduced region
+ *@op: REDUCE_SUM, REDUCE_CSUM or REDUCE_MINMAX
+ *@destination: Index of the destination register
+ *@max: pick the largest byte instead of the smallest one (REDUCE_MINMAX)
+ */
+static int libreduce(struct pcb_t *proc, uint32_t source, int op,
+                     uint32_t destination, int max)
+{
+  struct reduce_acc acc;
+  addr_t value;
+
+  /* destination was checked when the program was verified */
+  if (__reduce(proc, 0, source, op, &acc) != 0)
+    return -1;
+
+  switch (op)
+  {
+  case REDUCE_SUM:
+    value = acc.sum;
+    break;
+  case REDUCE_CSUM:
+    value = reduce_checksum(&acc);
+    break;
+  default:
+    value = max ? acc.max : acc.min;
+    break;
+  }
+  proc->regs[destination] = value;
+
+#ifdef IODUMP
+  iodump(proc, "IODUMP: PID %d REDUCE rgid=%d size=%llu result=%llu\n",
+         proc->pid, source, (unsigned long long)acc.pos, (unsigned long long)value);
+#endif
+  return 0;
+}
+
+int libsum(struct pcb_t *proc, uint32_t source, uint32_t destination)
+{
+  return libreduce(proc, source, REDUCE_SUM, destination, 0);
+}
+
+int libcsum(struct pcb_t *proc, uint32_t source, uint32_t destination)
+{
+  return libreduce(proc, source, REDUCE_CSUM, destination, 0);
+}
+
+int libmin(struct pcb_t *proc, uint32_t source, uint32_t destination)
+{
+  return libreduce(proc, source, REDUCE_MINMAX, destination, 0);
+}
+
+int libmax(struct pcb_t *proc, uint32_t source, uint32_t destination)
+{
+  return libreduce(proc, source, REDUCE_MINMAX, destination, 1);
+}
+
+/*libmemcmp - PAGING-based comparison of two region memory */
+int libmemcmp(
+    struct pcb_t *proc,   // Process executing the instruction
+    uint32_t source_a,    // Index of the first region
+    uint32_t source_b,    // Index of the second region
+    uint32_t destination) // Index of the destination register
+{
+  addr_t result;
+
+  if (__memcmp(proc, 0, source_a, source_b, &result) != 0)
+    return -1;
+
+  proc->regs[destination] = result;
+#ifdef IODUMP
+  iodump(proc, "IODUMP: PID %d MEMCMP rgid=%d rgid=%d result=%llu\n",
+         proc->pid, source_a, source_b, (unsigned long long)result);
+#endif
+  return 0;
+}
+
 /*free_pcb_memphy - collect all memphy of pcb
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -698,16 +1050,15 @@ int libwrite(
  */
 int free_pcb_memph(struct pcb_t *caller)
 {
-  pthread_mutex_lock(&mmvm_lock);
 
   /* guard NULL */
   if (!caller || !caller->krnl || !caller->krnl->mm) {
-    pthread_mutex_unlock(&mmvm_lock);
     return -1;
   }
+  pthread_mutex_lock(&caller->krnl->mmvm_lock);
     /* Nếu pgd chưa cấp phát thì không có gì để trả frame → return 0 an toàn */
   if (!caller->krnl->mm->pgd) {
-    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_unlock(&caller->krnl->mmvm_lock);
     return 0;
   }
   
@@ -733,7 +1084,7 @@ int free_pcb_memph(struct pcb_t *caller)
     }
   }
 
-  pthread_mutex_unlock(&mmvm_lock);
+  pthread_mutex_unlock(&caller->krnl->mmvm_lock);
   return 0;
 }
 
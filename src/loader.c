@@ -1,10 +1,40 @@
 
 #include "loader.h"
+#include "code.h"
+#include "slab.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-static uint32_t avail_pid = 1;
+/* Code segments shared by every process started from the same path.
+ * The segments are read-only once loaded, so sharing only needs a
+ * reference count, dropped by unload(). A segment is built outside
+ * cache_lock, those asking for it meanwhile wait on its entry */
+#define CODE_CACHE_SZ	64
+
+enum code_state {
+	CODE_BUILDING,
+	CODE_READY,
+	CODE_FAILED,	// Out of the cache, freed with its last reference
+};
+
+struct code_entry {
+	struct code_seg_t code;	// First, unload() gets back here from it
+	char path[100];
+	uint32_t priority;
+	int refs;
+	enum code_state state;
+	pthread_cond_t built;	// Signalled once no longer CODE_BUILDING
+	struct code_entry * next;
+};
+
+static struct code_entry * code_cache[CODE_CACHE_SZ];
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int cache_held = 0;	/* Unused segments are kept, see code_cache_hold() */
 
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
@@ -12,94 +42,553 @@ static uint32_t avail_pid = 1;
 #define OPT_READ	"read"
 #define OPT_WRITE	"write"
 #define OPT_SYSCALL	"syscall"
+#define OPT_MEMCPY	"memcpy"
+#define OPT_MEMSET	"memset"
+#define OPT_SUM		"sum"
+#define OPT_CSUM	"csum"
+#define OPT_MIN		"min"
+#define OPT_MAX		"max"
+#define OPT_MEMCMP	"memcmp"
+#define OPT_SET		"set"
+#define OPT_ADD		"add"
+#define OPT_SUB		"sub"
+#define OPT_MUL		"mul"
+#define OPT_CMP		"cmp"
+#define OPT_JMP		"jmp"
+#define OPT_JZ		"jz"
+#define OPT_JNZ		"jnz"
 
-static enum ins_opcode_t get_opcode(char * opt) {
-	if (!strcmp(opt, OPT_CALC)) {
-		return CALC;
-	}else if (!strcmp(opt, OPT_ALLOC)) {
-		return ALLOC;
-	}else if (!strcmp(opt, OPT_FREE)) {
-		return FREE;
-	}else if (!strcmp(opt, OPT_READ)) {
-		return READ;
-	}else if (!strcmp(opt, OPT_WRITE)) {
-		return WRITE;
-	}else if (!strcmp(opt, OPT_SYSCALL)) {
-		return SYSCALL;
-	}else{
-		printf("get_opcode return Opcode: %s\n", opt);
-		exit(1);
+/* Opcode names with the number of operands each one reads. The
+ * operands of syscall are optional and end with its line */
+static const struct opt_t {
+	const char * name;
+	enum ins_opcode_t opcode;
+	int nargs;
+} opts[] = {
+	{OPT_CALC,    CALC,    0},
+	{OPT_ALLOC,   ALLOC,   2},
+	{OPT_FREE,    FREE,    1},
+	{OPT_READ,    READ,    3},
+	{OPT_WRITE,   WRITE,   3},
+	{OPT_SYSCALL, SYSCALL, 4},
+	{OPT_MEMCPY,  MEMCPY,  3},
+	{OPT_MEMSET,  MEMSET,  3},
+	{OPT_SUM,     SUM,     2},
+	{OPT_CSUM,    CSUM,    2},
+	{OPT_MIN,     MIN,     2},
+	{OPT_MAX,     MAX,     2},
+	{OPT_MEMCMP,  MEMCMP,  3},
+	{OPT_SET,     SET,     2},
+	{OPT_ADD,     ADD,     3},
+	{OPT_SUB,     SUB,     3},
+	{OPT_MUL,     MUL,     3},
+	{OPT_CMP,     CMP,     3},
+	{OPT_JMP,     JMP,     1},
+	{OPT_JZ,      JZ,      2},
+	{OPT_JNZ,     JNZ,     2},
+};
+
+#define NUM_OPTS	(int)(sizeof(opts) / sizeof(opts[0]))
+
+/* Perfect hash of the opcode names: the first two characters, the last
+ * one and the length pick a distinct slot for every name. The table is
+ * filled on first use, and a new name that collides is caught there */
+#define OPT_HASH_SZ	64
+
+static int8_t opt_hash[OPT_HASH_SZ];
+static pthread_once_t opt_once = PTHREAD_ONCE_INIT;
+
+static uint32_t hash_opt(const char * s, size_t len) {
+	return ((uint8_t)s[0] + (uint8_t)s[1] + 4 * (uint8_t)s[len - 1] +
+		15 * len) % OPT_HASH_SZ;
+}
+
+static void init_opt_hash(void) {
+	int i;
+
+	memset(opt_hash, -1, sizeof(opt_hash));
+	for (i = 0; i < NUM_OPTS; i++) {
+		uint32_t h = hash_opt(opts[i].name, strlen(opts[i].name));
+		if (opt_hash[h] != -1) {
+			printf("Opcode hash collision: %s\n", opts[i].name);
+			exit(1);
+		}
+		opt_hash[h] = i;
 	}
 }
 
-struct pcb_t * load(const char * path) {
-	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
-	proc->page_table =
-		(struct page_table_t*)malloc(sizeof(struct page_table_t));
-	proc->bp = PAGE_SIZE;
-	proc->pc = 0;
+static const struct opt_t * get_opt(const char * s, size_t len) {
+	pthread_once(&opt_once, init_opt_hash);
+	if (len < 2)
+		return NULL;
+
+	int i = opt_hash[hash_opt(s, len)];
+	if (i < 0 || strlen(opts[i].name) != len || memcmp(opts[i].name, s, len))
+		return NULL;
+	return &opts[i];
+}
+
+/* Single pass tokenizer over the whole program text */
+struct scanner {
+	const char * p;
+	const char * end;
+	int line;
+};
+
+/* Skip blanks, and newlines too unless [in_line] */
+static void skip_space(struct scanner * sc, int in_line) {
+	while (sc->p < sc->end) {
+		char c = *sc->p;
+		if (c == '\n') {
+			if (in_line)
+				return;
+			sc->line++;
+		}else if (c != ' ' && c != '\t' && c != '\r') {
+			return;
+		}
+		sc->p++;
+	}
+}
+
+/* A number, negative ones wrap around as with scanf %u */
+static int scan_num(struct scanner * sc, int in_line, arg_t * v) {
+	const char * p;
+	int neg = 0;
+
+	skip_space(sc, in_line);
+	p = sc->p;
+	if (p < sc->end && (*p == '-' || *p == '+'))
+		neg = (*p++ == '-');
+	if (p == sc->end || *p < '0' || *p > '9')
+		return 0;
+
+	arg_t n = 0;
+	while (p < sc->end && *p >= '0' && *p <= '9')
+		n = n * 10 + (*p++ - '0');
+	sc->p = p;
+	*v = neg ? -n : n;
+	return 1;
+}
+
+static size_t scan_word(struct scanner * sc, const char ** word) {
+	skip_space(sc, 0);
+	*word = sc->p;
+	while (sc->p < sc->end && *sc->p != ' ' && *sc->p != '\t' &&
+	       *sc->p != '\r' && *sc->p != '\n')
+		sc->p++;
+	return sc->p - *word;
+}
 
-	/* Read process code from file */
+/* Read a compiled program, see code.h. The image is read as is, with
+ * no parsing, but copied rather than mapped on purpose: a later rewrite
+ * of the file does not change the code once verified. Return -1 if
+ * [file] is a compiled program that cannot be read, otherwise 0 with
+ * [*code] NULL if [file] is not one */
+static int load_binary(FILE * file, const char * path,
+		uint32_t * priority, struct code_seg_t ** out) {
+	struct code_hdr hdr;
+	struct stat st;
+
+	*out = NULL;
+	if (fread(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    memcmp(hdr.magic, CODE_MAGIC, sizeof(hdr.magic))) {
+		rewind(file);
+		return 0;
+	}
+	if (hdr.version != CODE_VERSION || fstat(fileno(file), &st) != 0 ||
+	    (uint64_t)st.st_size != sizeof(hdr) + (uint64_t)hdr.size) {
+		printf("Bad compiled program at '%s', recompile it\n", path);
+		return -1;
+	}
+
+	struct code_seg_t * code =
+		(struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	code->text = NULL;
+	code->dec = NULL;
+	code->count = hdr.count;
+	code->size = hdr.size;
+	code->compiled = 1;
+	code->verified = 0;
+	*priority = hdr.priority;
+
+	if (hdr.size >= CODE_DEMAND_MIN) {
+		/* Too large to keep whole, fetched on demand */
+		code->image = NULL;
+		code->fd = dup(fileno(file));
+		code->sum = (uint64_t *)calloc(hdr.size / CODE_CHUNK + 1,
+					       sizeof(uint64_t));
+		if (code->fd < 0) {
+			printf("Cannot open process at '%s'\n", path);
+			free(code->sum);
+			free(code);
+			return -1;
+		}
+		*out = code;
+		return 0;
+	}
+
+	code->image = (uint8_t *)malloc(hdr.size + 1);
+	code->fd = -1;
+	code->sum = NULL;
+	if (hdr.size && fread(code->image, hdr.size, 1, file) != 1) {
+		printf("Cannot read process at '%s'\n", path);
+		free(code->image);
+		free(code);
+		return -1;
+	}
+	*out = code;
+	return 0;
+}
+
+/* Parse a text program and encode it, NULL if it cannot be read,
+ * parsed or encoded */
+static struct code_seg_t * load_text(FILE * file, const char * path,
+		uint32_t * priority) {
+	struct stat st;
+	if (fstat(fileno(file), &st) != 0 || st.st_size == 0) {
+		printf("Cannot read process description at '%s'\n", path);
+		return NULL;
+	}
+	char * buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			fileno(file), 0);
+	if (buf == MAP_FAILED) {
+		printf("Cannot map process description at '%s'\n", path);
+		return NULL;
+	}
+
+	struct scanner sc = {buf, buf + st.st_size, 1};
+	struct code_seg_t * code =
+		(struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	arg_t prio, count;
+	code->dec = NULL;
+	code->compiled = 0;
+	code->verified = 0;
+	code->fd = -1;
+	code->sum = NULL;
+	code->text = NULL;
+	if (!scan_num(&sc, 0, &prio) || !scan_num(&sc, 0, &count))
+		goto bad;
+	*priority = prio;
+	code->count = count;
+	code->text = (struct inst_t*)calloc(
+		code->count, sizeof(struct inst_t)
+	);
+	if (code->text == NULL)
+		goto bad;
+
+	uint32_t i;
+	for (i = 0; i < code->count; i++) {
+		const char * word;
+		size_t len = scan_word(&sc, &word);
+		const struct opt_t * opt = get_opt(word, len);
+		if (opt == NULL) {
+			printf("get_opcode return Opcode: %.*s\n", (int)len, word);
+			goto bad;
+		}
+
+		struct inst_t * ins = &code->text[i];
+		arg_t arg[4] = {0, 0, 0, 0};
+		int k;
+		ins->opcode = opt->opcode;
+		for (k = 0; k < opt->nargs; k++) {
+			if (opt->opcode == SYSCALL) {
+				if (!scan_num(&sc, 1, &arg[k]))
+					break;
+			}else if (!scan_num(&sc, 0, &arg[k])) {
+				goto bad;
+			}
+		}
+		ins->arg_0 = arg[0];
+		ins->arg_1 = arg[1];
+		ins->arg_2 = arg[2];
+		ins->arg_3 = arg[3];
+	}
+	munmap(buf, st.st_size);
+
+	/* Encode once, the CPU only executes the packed image */
+	int err = encode(code);
+	free(code->text);
+	code->text = NULL;
+	if (err != 0) {
+		free(code);
+		return NULL;
+	}
+	return code;
+
+bad:
+	printf("Cannot parse process at '%s', line %d\n", path, sc.line);
+	munmap(buf, st.st_size);
+	free(code->text);
+	free(code);
+	return NULL;
+}
+
+/* Release the image of a code segment, not the segment itself */
+static void release_code(struct code_seg_t * code) {
+	free(code->image);
+	if (code->fd >= 0)
+		close(code->fd);
+	free(code->sum);
+	free(code->dec);
+}
+
+struct code_seg_t * load_code(const char * path, uint32_t * priority) {
 	FILE * file;
+	struct code_seg_t * code;
 	if ((file = fopen(path, "r")) == NULL) {
 		printf("Cannot find process description at '%s'\n", path);
-		exit(1);		
-	}
-	snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
-	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
-	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
-	);
-	uint32_t i = 0;
-	char buf[200];
-	for (i = 0; i < proc->code->size; i++) {
-		fscanf(file, "%s", opcode);
-		proc->code->text[i].opcode = get_opcode(opcode);
-		switch(proc->code->text[i].opcode) {
-		case CALC:
-			break;
-		case ALLOC:
-			fscanf(
-				file,
-				"" FORMAT_ARG " " FORMAT_ARG "\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
-			);
-			break;
-		case FREE:
-			fscanf(file, "" FORMAT_ARG "\n", &proc->code->text[i].arg_0);
-			break;
-		case READ:
-		case WRITE:
-			fscanf(
-				file,
-				"" FORMAT_ARG " " FORMAT_ARG " " FORMAT_ARG "\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1,
-				&proc->code->text[i].arg_2
-			);
-			break;	
-		case SYSCALL:
-			fgets(buf, sizeof(buf), file);
-			sscanf(buf, "" FORMAT_ARG "" FORMAT_ARG "" FORMAT_ARG "" FORMAT_ARG "",
-			           &proc->code->text[i].arg_0,
-			           &proc->code->text[i].arg_1,
-			           &proc->code->text[i].arg_2,
-			           &proc->code->text[i].arg_3
-			);
+		return NULL;
+	}
+	if (load_binary(file, path, priority, &code) != 0) {
+		fclose(file);
+		return NULL;
+	}
+	if (code == NULL)
+		code = load_text(file, path, priority);
+	fclose(file);
+
+	/* Checked once here, the CPU runs it unchecked */
+	if (code != NULL && verify(code) != 0) {
+		release_code(code);
+		free(code);
+		code = NULL;
+	}
+	if (code != NULL) {
+		code->verified = 1;
+		code->heap = heap_demand(code);
+	}
+	return code;
+}
+
+static uint32_t path_hash(const char * path) {
+	uint32_t h = 2166136261u;	/* FNV-1a */
+	while (*path) {
+		h ^= (uint8_t)*path++;
+		h *= 16777619u;
+	}
+	return h % CODE_CACHE_SZ;
+}
+
+/* Makes the code named [path] on a cache miss */
+typedef struct code_seg_t * (*code_builder_t)(const char * path,
+		uint32_t * priority);
+
+static void free_entry(struct code_entry * e) {
+	if (e->state == CODE_READY)
+		release_code(&e->code);
+	pthread_cond_destroy(&e->built);
+	free(e);
+}
+
+/* Take [e] out of the cache, cache_lock held */
+static void unlink_entry(struct code_entry * e) {
+	struct code_entry ** pp = &code_cache[path_hash(e->path)];
+
+	while (*pp != e)
+		pp = &(*pp)->next;
+	*pp = e->next;
+}
+
+/* Build the code of the new entry [e], cache_lock held on entry and
+ * on return but not meanwhile, so that programs load in parallel */
+static void build_entry(struct code_entry * e, code_builder_t build) {
+	uint32_t priority;
+	struct code_seg_t * code;
+
+	pthread_mutex_unlock(&cache_lock);
+	code = build(e->path, &priority);
+	if (code != NULL)
+		decode(code);	/* Once for all the processes sharing it */
+	pthread_mutex_lock(&cache_lock);
+	if (code != NULL) {
+		e->code = *code;
+		e->priority = priority;
+		e->state = CODE_READY;
+		free(code);
+	}else{
+		/* Not kept, a later arrival tries again */
+		e->state = CODE_FAILED;
+		unlink_entry(e);
+	}
+	pthread_cond_broadcast(&e->built);
+}
+
+/* Code of [path] from the cache, built on the first use */
+static struct code_seg_t * get_code(const char * path, uint32_t * priority,
+		code_builder_t build) {
+	uint32_t h = path_hash(path);
+	struct code_entry * e;
+
+	pthread_mutex_lock(&cache_lock);
+	for (e = code_cache[h]; e != NULL; e = e->next) {
+		if (!strcmp(e->path, path))
 			break;
-		default:
-			printf("Opcode: %s\n", opcode);
-			exit(1);
+	}
+	if (e == NULL) {
+		e = (struct code_entry *)calloc(1, sizeof(struct code_entry));
+		snprintf(e->path, sizeof(e->path), "%s", path);
+		e->state = CODE_BUILDING;
+		pthread_cond_init(&e->built, NULL);
+		e->refs = 1;
+		e->next = code_cache[h];
+		code_cache[h] = e;
+		build_entry(e, build);
+	}else{
+		e->refs++;
+		while (e->state == CODE_BUILDING)
+			pthread_cond_wait(&e->built, &cache_lock);
+	}
+	if (e->state == CODE_FAILED) {
+		if (--e->refs == 0)
+			free_entry(e);
+		pthread_mutex_unlock(&cache_lock);
+		return NULL;
+	}
+	*priority = e->priority;
+	pthread_mutex_unlock(&cache_lock);
+	return &e->code;
+}
+
+static void put_code(struct code_seg_t * code) {
+	struct code_entry * e = (struct code_entry *)code;
+
+	pthread_mutex_lock(&cache_lock);
+	if (--e->refs > 0 || cache_held > 0) {
+		pthread_mutex_unlock(&cache_lock);
+		return;
+	}
+	unlink_entry(e);
+	pthread_mutex_unlock(&cache_lock);
+
+	free_entry(e);
+}
+
+void code_cache_hold(void) {
+	pthread_mutex_lock(&cache_lock);
+	cache_held++;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void code_cache_release(void) {
+	struct code_entry * unused = NULL;
+	struct code_entry * e;
+	int h;
+
+	pthread_mutex_lock(&cache_lock);
+	if (--cache_held == 0) {
+		for (h = 0; h < CODE_CACHE_SZ; h++) {
+			struct code_entry ** pp = &code_cache[h];
+			while ((e = *pp) != NULL) {
+				if (e->refs > 0) {
+					pp = &e->next;
+					continue;
+				}
+				*pp = e->next;
+				e->next = unused;
+				unused = e;
+			}
 		}
 	}
+	pthread_mutex_unlock(&cache_lock);
+
+	while ((e = unused) != NULL) {
+		unused = e->next;
+		free_entry(e);
+	}
+}
+
+static struct kmem_cache * pcb_cache;
+static pthread_once_t pcb_once = PTHREAD_ONCE_INIT;
+
+static void pcb_cache_create(void) {
+	pcb_cache = kmem_cache_create("pcb_t", sizeof(struct pcb_t));
+}
+
+/* Code of a trace job, named "job:<burst>:<mem>" so that the jobs
+ * with the same demands share it */
+#define JOB_KEY	"job:%u:%lu"
+
+static struct code_seg_t * job_code(const char * key, uint32_t * priority) {
+	struct code_seg_t * code;
+	unsigned int burst;
+	unsigned long mem;
+
+	if (sscanf(key, JOB_KEY, &burst, &mem) != 2)
+		return NULL;
+	code = (struct code_seg_t *)malloc(sizeof(struct code_seg_t));
+	code->dec = NULL;
+	code->compiled = 0;
+	code->verified = 0;
+	code->fd = -1;
+	code->sum = NULL;
+	if (encode_job(code, burst, mem) != 0) {
+		free(code);
+		return NULL;
+	}
+	code->verified = verify(code) == 0;
+	code->heap = heap_demand(code);
+	*priority = 0;
+	return code;
+}
+
+static struct pcb_t * new_proc(const char * path, code_builder_t build) {
+	uint32_t priority;
+
+	/* Read process code from file, or build it */
+	struct code_seg_t * code = get_code(path, &priority, build);
+	if (code == NULL)
+		return NULL;
+
+	/* Create new PCB for the new process */
+	pthread_once(&pcb_once, pcb_cache_create);
+	struct pcb_t * proc = (struct pcb_t * )kmem_cache_alloc(pcb_cache);
+	if (proc == NULL) {
+		printf("Cannot allocate process for '%s'\n", path);
+		exit(1);
+	}
+	proc->pid = 0;	/* Given on admission, in arrival order */
+#ifdef MM_PAGING
+	proc->page_table = NULL;	/* Only the legacy memory uses it */
+#else
+	proc->page_table =
+		(struct page_table_t*)malloc(sizeof(struct page_table_t));
+#endif
+	proc->mm = NULL;
+	proc->bp = PAGE_SIZE;
+	proc->pc = 0;
+	proc->cpu_time = 0;
+	proc->quiet = 0;
+	snprintf(proc->path, sizeof(proc->path), "%s", path);
+	proc->priority = priority;
+	proc->code = code;
+	proc->win = code_window_new(proc->code);
 	return proc;
 }
 
+struct pcb_t * load(const char * path) {
+	return new_proc(path, load_code);
+}
+
+struct pcb_t * load_job(uint32_t burst, unsigned long mem, uint32_t prio) {
+	char key[64];
+	struct pcb_t * proc;
+
+	snprintf(key, sizeof(key), JOB_KEY, burst, mem);
+	proc = new_proc(key, job_code);
+	if (proc != NULL)
+		proc->priority = prio;
+	return proc;
+}
 
+struct pcb_t * reload(const char * path) {
+	if (!strncmp(path, "job:", 4))
+		return new_proc(path, job_code);
+	return load(path);
+}
 
+void unload(struct pcb_t * proc) {
+	put_code(proc->code);
+	free(proc->win);
+	free(proc->page_table);
+	kmem_cache_free(pcb_cache, proc);
+}
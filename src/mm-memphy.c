@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
@@ -47,7 +48,7 @@ int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset)
  */
 int MEMPHY_seq_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
 {
-   if (mp == NULL)
+   if (mp == NULL || addr >= mp->maxsz)
       return -1;
 
    if (!mp->rdmflg)
@@ -67,7 +68,7 @@ int MEMPHY_seq_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
  */
 int MEMPHY_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
 {
-   if (mp == NULL)
+   if (mp == NULL || addr >= mp->maxsz)
       return -1;
 
    if (mp->rdmflg)
@@ -87,7 +88,7 @@ int MEMPHY_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
 int MEMPHY_seq_write(struct memphy_struct *mp, addr_t addr, BYTE value)
 {
 
-   if (mp == NULL)
+   if (mp == NULL || addr >= mp->maxsz)
       return -1;
 
    if (!mp->rdmflg)
@@ -107,7 +108,7 @@ int MEMPHY_seq_write(struct memphy_struct *mp, addr_t addr, BYTE value)
  */
 int MEMPHY_write(struct memphy_struct *mp, addr_t addr, BYTE data)
 {
-   if (mp == NULL)
+   if (mp == NULL || addr >= mp->maxsz)
       return -1;
 
    if (mp->rdmflg)
@@ -118,6 +119,68 @@ int MEMPHY_write(struct memphy_struct *mp, addr_t addr, BYTE data)
    return 0;
 }
 
+/*
+ *  MEMPHY_memcpy - copy a block of bytes inside MEMPHY device
+ *  @mp: memphy struct
+ *  @dst: destination address
+ *  @src: source address
+ *  @len: number of bytes
+ */
+int MEMPHY_memcpy(struct memphy_struct *mp, addr_t dst, addr_t src, addr_t len)
+{
+   addr_t i;
+   BYTE data;
+
+   if (mp == NULL)
+      return -1;
+
+   if (src + len > mp->maxsz || dst + len > mp->maxsz)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      memmove(mp->storage + dst, mp->storage + src, len);
+      return 0;
+   }
+
+   /* Sequential access device */
+   for (i = 0; i < len; i++)
+   {
+      MEMPHY_seq_read(mp, src + i, &data);
+      MEMPHY_seq_write(mp, dst + i, data);
+   }
+   return 0;
+}
+
+/*
+ *  MEMPHY_memset - fill a block of bytes of MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: address
+ *  @data: filled value
+ *  @len: number of bytes
+ */
+int MEMPHY_memset(struct memphy_struct *mp, addr_t addr, BYTE data, addr_t len)
+{
+   addr_t i;
+
+   if (mp == NULL)
+      return -1;
+
+   if (addr + len > mp->maxsz)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      memset(mp->storage + addr, data, len);
+      return 0;
+   }
+
+   /* Sequential access device */
+   for (i = 0; i < len; i++)
+      MEMPHY_seq_write(mp, addr + i, data);
+   return 0;
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
@@ -135,6 +198,7 @@ int MEMPHY_format(struct memphy_struct *mp, int pagesz)
    /* Init head of free framephy list */
    fst = malloc(sizeof(struct framephy_struct));
    fst->fpn = iter;
+   fst->fp_next = NULL;
    mp->free_fp_list = fst;
 
    /* We have list with first element, fill in the rest num-1 element member*/
@@ -196,7 +260,10 @@ int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
 {
    mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
    mp->maxsz = max_size;
+   mp->mapped = 0;
    memset(mp->storage, 0, max_size * sizeof(BYTE));
+   mp->free_fp_list = NULL;
+   mp->used_fp_list = NULL;
 
    MEMPHY_format(mp, PAGING_PAGESZ);
 
@@ -208,4 +275,30 @@ int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
    return 0;
 }
 
+/*
+ *  Release a MEMPHY struct, once no process uses it
+ */
+int free_memphy(struct memphy_struct *mp)
+{
+   struct framephy_struct *fp;
+
+   while ((fp = mp->free_fp_list) != NULL)
+   {
+      mp->free_fp_list = fp->fp_next;
+      free(fp);
+   }
+   while ((fp = mp->used_fp_list) != NULL)
+   {
+      mp->used_fp_list = fp->fp_next;
+      free(fp);
+   }
+   if (mp->mapped)
+      munmap(mp->storage, mp->maxsz);
+   else
+      free(mp->storage);
+   mp->storage = NULL;
+
+   return 0;
+}
+
 // #endif
@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Memory physical reduction kernels mm/mm-reduce.c
+ *
+ * The kernels work straight on the storage of random access MEMPHY
+ * devices. Each one has a scalar version and, on x86, an SSE2 and an
+ * AVX2 version. The fastest version supported by the host is picked
+ * once, on first use.
+ */
+
+#include "mm.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REDUCE_X86 1
+#include <immintrin.h>
+#endif
+
+struct reduce_ops {
+   uint64_t (*sum)(const uint8_t *p, size_t n);
+   void (*sum2)(const uint8_t *p, size_t n, uint64_t *even, uint64_t *odd);
+   void (*minmax)(const uint8_t *p, size_t n, uint8_t *min, uint8_t *max);
+   size_t (*cmp)(const uint8_t *a, const uint8_t *b, size_t n);
+};
+
+/*
+ * Scalar kernels, also used for the tail of the vector ones
+ */
+static uint64_t sum_scalar(const uint8_t *p, size_t n)
+{
+   uint64_t sum = 0;
+   size_t i;
+   for (i = 0; i < n; i++)
+      sum += p[i];
+   return sum;
+}
+
+static void sum2_scalar(const uint8_t *p, size_t n, uint64_t *even, uint64_t *odd)
+{
+   size_t i;
+   for (i = 0; i + 1 < n; i += 2)
+   {
+      *even += p[i];
+      *odd += p[i + 1];
+   }
+   if (i < n)
+      *even += p[i];
+}
+
+static void minmax_scalar(const uint8_t *p, size_t n, uint8_t *min, uint8_t *max)
+{
+   size_t i;
+   for (i = 0; i < n; i++)
+   {
+      if (p[i] < *min)
+         *min = p[i];
+      if (p[i] > *max)
+         *max = p[i];
+   }
+}
+
+static size_t cmp_scalar(const uint8_t *a, const uint8_t *b, size_t n)
+{
+   size_t i;
+   for (i = 0; i < n; i++)
+      if (a[i] != b[i])
+         break;
+   return i;
+}
+
+static const struct reduce_ops reduce_scalar = {
+   sum_scalar, sum2_scalar, minmax_scalar, cmp_scalar
+};
+
+#ifdef REDUCE_X86
+/*
+ * SSE2 kernels, 16 bytes per step
+ */
+__attribute__((target("sse2")))
+static uint64_t sum_sse2(const uint8_t *p, size_t n)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i acc = zero;
+   uint64_t lane[2];
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16)
+      acc = _mm_add_epi64(acc,
+            _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(p + i)), zero));
+
+   _mm_storeu_si128((__m128i *)lane, acc);
+   return lane[0] + lane[1] + sum_scalar(p + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sum2_sse2(const uint8_t *p, size_t n, uint64_t *even, uint64_t *odd)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i lo = _mm_set1_epi16(0x00ff);
+   __m128i acce = zero, acco = zero;
+   uint64_t lane[2];
+   size_t i;
+
+   /* Little endian: even bytes are the low half of each 16-bit lane */
+   for (i = 0; i + 16 <= n; i += 16)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+      acce = _mm_add_epi64(acce, _mm_sad_epu8(_mm_and_si128(v, lo), zero));
+      acco = _mm_add_epi64(acco, _mm_sad_epu8(_mm_srli_epi16(v, 8), zero));
+   }
+
+   _mm_storeu_si128((__m128i *)lane, acce);
+   *even += lane[0] + lane[1];
+   _mm_storeu_si128((__m128i *)lane, acco);
+   *odd += lane[0] + lane[1];
+   sum2_scalar(p + i, n - i, even, odd);
+}
+
+__attribute__((target("sse2")))
+static void minmax_sse2(const uint8_t *p, size_t n, uint8_t *min, uint8_t *max)
+{
+   __m128i vmin = _mm_set1_epi8((char)*min);
+   __m128i vmax = _mm_set1_epi8((char)*max);
+   uint8_t lane[16];
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16)
+   {
+      __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+      vmin = _mm_min_epu8(vmin, v);
+      vmax = _mm_max_epu8(vmax, v);
+   }
+
+   _mm_storeu_si128((__m128i *)lane, vmin);
+   minmax_scalar(lane, sizeof(lane), min, max);
+   _mm_storeu_si128((__m128i *)lane, vmax);
+   minmax_scalar(lane, sizeof(lane), min, max);
+   minmax_scalar(p + i, n - i, min, max);
+}
+
+__attribute__((target("sse2")))
+static size_t cmp_sse2(const uint8_t *a, const uint8_t *b, size_t n)
+{
+   size_t i;
+
+   for (i = 0; i + 16 <= n; i += 16)
+   {
+      __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+      __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+      unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+      if (mask != 0xffff)
+         return i + __builtin_ctz(~mask);
+   }
+   return i + cmp_scalar(a + i, b + i, n - i);
+}
+
+static const struct reduce_ops reduce_sse2 = {
+   sum_sse2, sum2_sse2, minmax_sse2, cmp_sse2
+};
+
+/*
+ * AVX2 kernels, 32 bytes per step
+ */
+__attribute__((target("avx2")))
+static uint64_t sum_avx2(const uint8_t *p, size_t n)
+{
+   __m256i zero = _mm256_setzero_si256();
+   __m256i acc = zero;
+   uint64_t lane[4];
+   size_t i;
+
+   for (i = 0; i + 32 <= n; i += 32)
+      acc = _mm256_add_epi64(acc,
+            _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)(p + i)), zero));
+
+   _mm256_storeu_si256((__m256i *)lane, acc);
+   return lane[0] + lane[1] + lane[2] + lane[3] + sum_sse2(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void sum2_avx2(const uint8_t *p, size_t n, uint64_t *even, uint64_t *odd)
+{
+   __m256i zero = _mm256_setzero_si256();
+   __m256i lo = _mm256_set1_epi16(0x00ff);
+   __m256i acce = zero, acco = zero;
+   uint64_t lane[4];
+   size_t i;
+
+   for (i = 0; i + 32 <= n; i += 32)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+      acce = _mm256_add_epi64(acce, _mm256_sad_epu8(_mm256_and_si256(v, lo), zero));
+      acco = _mm256_add_epi64(acco, _mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero));
+   }
+
+   _mm256_storeu_si256((__m256i *)lane, acce);
+   *even += lane[0] + lane[1] + lane[2] + lane[3];
+   _mm256_storeu_si256((__m256i *)lane, acco);
+   *odd += lane[0] + lane[1] + lane[2] + lane[3];
+   sum2_sse2(p + i, n - i, even, odd);
+}
+
+__attribute__((target("avx2")))
+static void minmax_avx2(const uint8_t *p, size_t n, uint8_t *min, uint8_t *max)
+{
+   __m256i vmin = _mm256_set1_epi8((char)*min);
+   __m256i vmax = _mm256_set1_epi8((char)*max);
+   uint8_t lane[32];
+   size_t i;
+
+   for (i = 0; i + 32 <= n; i += 32)
+   {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+      vmin = _mm256_min_epu8(vmin, v);
+      vmax = _mm256_max_epu8(vmax, v);
+   }
+
+   _mm256_storeu_si256((__m256i *)lane, vmin);
+   minmax_scalar(lane, sizeof(lane), min, max);
+   _mm256_storeu_si256((__m256i *)lane, vmax);
+   minmax_scalar(lane, sizeof(lane), min, max);
+   minmax_sse2(p + i, n - i, min, max);
+}
+
+__attribute__((target("avx2")))
+static size_t cmp_avx2(const uint8_t *a, const uint8_t *b, size_t n)
+{
+   size_t i;
+
+   for (i = 0; i + 32 <= n; i += 32)
+   {
+      __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+      __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+      unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+      if (mask != 0xffffffffu)
+         return i + __builtin_ctz(~mask);
+   }
+   return i + cmp_sse2(a + i, b + i, n - i);
+}
+
+static const struct reduce_ops reduce_avx2 = {
+   sum_avx2, sum2_avx2, minmax_avx2, cmp_avx2
+};
+#endif
+
+static const struct reduce_ops *reduce_impl = &reduce_scalar;
+static pthread_once_t reduce_once = PTHREAD_ONCE_INIT;
+
+static void reduce_select(void)
+{
+#ifdef REDUCE_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+      reduce_impl = &reduce_avx2;
+   else if (__builtin_cpu_supports("sse2"))
+      reduce_impl = &reduce_sse2;
+#endif
+}
+
+static const struct reduce_ops *reduce_get(void)
+{
+   pthread_once(&reduce_once, reduce_select);
+   return reduce_impl;
+}
+
+/*
+ *  MEMPHY_reduce - fold a block of MEMPHY device into a reduction
+ *  @mp: memphy struct
+ *  @addr: address
+ *  @len: number of bytes
+ *  @op: REDUCE_SUM, REDUCE_CSUM or REDUCE_MINMAX
+ *  @acc: running state, blocks of a region are folded in order
+ */
+int MEMPHY_reduce(struct memphy_struct *mp, addr_t addr, addr_t len,
+                  int op, struct reduce_acc *acc)
+{
+   const struct reduce_ops *ops = reduce_get();
+   uint8_t buf[PAGING_PAGESZ];
+   const uint8_t *p;
+   addr_t done, chunk, i;
+
+   if (mp == NULL || addr + len > mp->maxsz)
+      return -1;
+
+   for (done = 0; done < len; done += chunk)
+   {
+      chunk = len - done;
+      if (mp->rdmflg)
+      {
+         p = (const uint8_t *)mp->storage + addr + done;
+      }
+      else
+      { /* Sequential access device, stage bytes through a buffer */
+         if (chunk > sizeof(buf))
+            chunk = sizeof(buf);
+         for (i = 0; i < chunk; i++)
+            MEMPHY_read(mp, addr + done + i, (BYTE *)&buf[i]);
+         p = buf;
+      }
+
+      switch (op)
+      {
+      case REDUCE_SUM:
+         acc->sum += ops->sum(p, chunk);
+         break;
+      case REDUCE_CSUM:
+         /* Word boundaries follow the offset inside the region */
+         if (acc->pos & 1)
+            ops->sum2(p, chunk, &acc->sum_odd, &acc->sum_even);
+         else
+            ops->sum2(p, chunk, &acc->sum_even, &acc->sum_odd);
+         break;
+      case REDUCE_MINMAX:
+         ops->minmax(p, chunk, &acc->min, &acc->max);
+         break;
+      default:
+         return -1;
+      }
+      acc->pos += chunk;
+   }
+   return 0;
+}
+
+/*
+ *  MEMPHY_memcmp - find the first differing byte of two blocks
+ *  @mp: memphy struct
+ *  @a: address of the first block
+ *  @b: address of the second block
+ *  @len: number of bytes
+ *  @diff: offset of the first differing byte, len if none
+ */
+int MEMPHY_memcmp(struct memphy_struct *mp, addr_t a, addr_t b, addr_t len,
+                  addr_t *diff)
+{
+   BYTE va, vb;
+   addr_t i;
+
+   if (mp == NULL || a + len > mp->maxsz || b + len > mp->maxsz)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      *diff = reduce_get()->cmp((const uint8_t *)mp->storage + a,
+                                (const uint8_t *)mp->storage + b, len);
+      return 0;
+   }
+
+   /* Sequential access device */
+   for (i = 0; i < len; i++)
+   {
+      MEMPHY_read(mp, a + i, &va);
+      MEMPHY_read(mp, b + i, &vb);
+      if (va != vb)
+         break;
+   }
+   *diff = i;
+   return 0;
+}
+
+/*
+ *  reduce_checksum - 16-bit ones' complement checksum (RFC 1071)
+ *  of the bytes folded into a REDUCE_CSUM reduction
+ */
+uint16_t reduce_checksum(struct reduce_acc *acc)
+{
+   uint64_t sum = (acc->sum_even << 8) + acc->sum_odd;
+
+   while (sum >> 16)
+      sum = (sum & 0xffff) + (sum >> 16);
+   return (uint16_t)~sum;
+}
+// #endif
@@ -373,7 +373,6 @@ init_vm_rg, enlist_vm_rg_node, enlist_pgn_node
 int init_mm(struct mm_struct *mm, struct pcb_t *caller) //NHÓM 5
 
 {
-  (void)caller;
   struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
 
   /* TODO init page table directory */
@@ -397,7 +396,12 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller) //NHÓM 5
   vma0->vm_start = 0;
 
   /* khởi tạo heap ban đầu và free-list an toàn */
-  vma0->vm_end = vma0->vm_start + PAGING_SBRK_INIT_SZ;
+  /* Reserve the heap the program was found to need at load time
+   * (heap_demand), so its allocations never have to grow vma0 */
+  addr_t heapsz = PAGING_SBRK_INIT_SZ;
+  if (caller && caller->code && caller->code->heap > heapsz)
+    heapsz = PAGING_PAGE_ALIGNSZ(caller->code->heap);
+  vma0->vm_end = vma0->vm_start + heapsz;
   vma0->sbrk = vma0->vm_end;
   vma0->vm_freerg_list = NULL;  /* <— rất quan trọng: tránh nối vào rác */
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
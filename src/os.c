@@ -1,158 +1,699 @@
 
+#include "os.h"
 #include "cpu.h"
 #include "timer.h"
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "slab.h"
+#include "stats.h"
+#include "evlog.h"
+#include "trace.h"
+#include "ckpt.h"
 
+#include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
-static int time_slot;
-static int num_cpus;
-static int done = 0;
-static struct krnl_t os;
-
-#ifdef MM_PAGING
-static int memramsz;
-static int memswpsz[PAGING_MAX_MMSWP];
-
-struct mmpaging_ld_args {
-	/* A dispatched argument struct to compact many-fields passing to loader */
-	int vmemsz;
-	struct memphy_struct *mram;
-	struct memphy_struct **mswp;
-	struct memphy_struct *active_mswp;
-	int active_mswp_id;
-	struct timer_id_t  *timer_id;
+/* Arrivals are read as the loader needs them: first the [num_processes]
+ * ones listed in the configure file, then, in streaming mode, those
+ * written to ld_stream until its writers close it */
+struct ld_arrival {
+	unsigned long start_time;
+	unsigned long prio;
+	char path[100];
+	int job;		/* A trace job, run without program file */
+	unsigned long burst;
+	unsigned long mem;
+	struct pcb_t * proc;	/* Prepared PCB, NULL until ready */
 };
-#endif
 
-static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
-#ifdef MLQ_SCHED
-	unsigned long * prio;
-#endif
-} ld_processes;
-int num_processes;
+enum cpu_state_t {
+	CPU_OFFLINE,
+	CPU_ONLINE,
+	CPU_DYING,	// Offline requested, the CPU leaves at its next slot
+};
 
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
+	enum cpu_state_t state;
+	struct os_t * os;
+	/* Kept here rather than by the thread, for a snapshot to see */
+	struct pcb_t * proc;	// Running process
+	int time_left;		// Slots left of its quantum
+	uint64_t skip;		// Slots to sleep through first, see timer_at()
+	uint64_t detailed;	// Instructions run, see stats_sampled()
+	uint64_t forwarded;
+};
+
+/* Turns of the devices in a deterministic run, see timer_ordered():
+ * arrivals are admitted first, then the hotplug timeline is applied,
+ * then the CPUs go by id */
+#define TURN_LOADER	0
+#define TURN_HOTPLUG	1
+#define TURN_CPU(id)	(2 + (id))
+
+/* CPU hotplug timeline read from the configure file */
+struct hotplug_event {
+	unsigned long time;
+	int id;
+	int online;
+};
+
+/* A simulation, see os_run(). The kernel comes first so that the
+ * kernel services called with a krnl_t get back to the rest of it */
+struct os_t {
+	struct krnl_t krnl;
+	const char * config;		/* Configure file, under input/ */
+	int time_slot;
+	int num_cpus;
+	int done;
+	int policy;
+	int budget;
+	unsigned long limit;		/* Arrivals read at most, 0 for all */
+	int deterministic;		/* See timer_ordered() */
+	struct stats_t stats;
+
+#ifdef MM_PAGING
+	int memramsz;
+	int memswpsz[PAGING_MAX_MMSWP];
+	struct memphy_struct mram;
+	struct memphy_struct mswp[PAGING_MAX_MMSWP];
+#endif
+
+	FILE * ld_config;
+	FILE * ld_stream;
+	struct trace * ld_trace;	/* Replaces the configured list */
+	const char * ld_trace_path;
+	unsigned long ld_jobs;		/* Jobs read from ld_trace */
+	int num_processes;
+	int listed;			/* Arrivals of the list read */
+
+	/* Open-loop mode: instead of the configured arrivals, [ol_count]
+	 * processes drawn from the programs of the configure file arrive
+	 * with exponential inter-arrival times, [ol_rate] per slot on
+	 * average */
+	double ol_rate;
+	unsigned long ol_count;
+	uint64_t ol_seed;
+	uint64_t seed;			/* ol_seed before the first draw */
+	struct ld_arrival * ol_catalogue;
+	int ol_size;
+	unsigned long ol_drawn;
+	double ol_time;
+
+	struct cpu_args cpus[MAX_CPU];
+	int nr_active;			/* CPUs in CPU_ONLINE state */
+	int nr_running;			/* CPU threads not yet exited */
+	pthread_mutex_t hotplug_lock;
+	pthread_cond_t hotplug_cond;
+	struct hotplug_event * hp_events;
+	int num_hp_events;
+	int hp_next;			/* Next event of the timeline */
+	struct timer_id_t * hp_event;
+
+	/* Loader pipeline, see ld_routine() */
+	struct ld_arrival ld_ring[LOADER_AHEAD];
+	int ld_next;			/* Next arrival to read */
+	int ld_admitted;		/* Arrivals handed to the scheduler */
+	uint64_t ld_due;		/* Slot the next one arrives in */
+	int ld_end;			/* No arrival left to read */
+	uint32_t avail_pid;
+	int ld_workers;			/* Threads preparing arrivals */
+	pthread_mutex_t ld_lock;
+	pthread_cond_t ld_cond;
+	pthread_mutex_t ld_src_lock;
+	struct timer_id_t * ld_event;
+
+	/* Snapshot to write, see os_checkpoint() */
+	const char * ck_path;
+	int ck_written;
+	char ck_names[2][100];		/* Configure file and trace restored */
+	int restored;			/* Resumed from a snapshot */
 };
 
+/* Take a CPU going offline out, hotplug_lock held. Its running process
+ * is handed over to the ready queue, where a CPU online picks it up: one
+ * about to stop looks at the queue again under the lock. With no CPU
+ * online left to do so, the CPU stays online instead. Return 0 if it
+ * left */
+static int cpu_leave(struct cpu_args * cpu) {
+	struct os_t * os = cpu->os;
+	struct krnl_t * krnl = &os->krnl;
+	int id = cpu->id;
+
+	if (cpu->proc != NULL && cpu->proc->pc == cpu->proc->code->size) {
+		fprintf(krnl->out, "\tCPU %d: Processed %2d has finished\n",
+			id ,cpu->proc->pid);
+		stats_finish(krnl->stats, cpu->proc, current_time(krnl->timer));
+		evlog_finish(krnl->evlog, cpu->proc);
+		finish_proc(cpu->proc);
+		unload(cpu->proc);
+		cpu->proc = NULL;
+		cpu->time_left = 0;
+	}
+	if (os->nr_active == 0) {
+		if (cpu->proc == NULL)
+			cpu->proc = get_proc(krnl);
+		if (cpu->proc != NULL) {
+			cpu->state = CPU_ONLINE;
+			os->nr_active++;
+			fprintf(krnl->out, "\tCPU %d stays online, no CPU is"
+				" left to run process %2d\n", id, cpu->proc->pid);
+			return -1;
+		}
+	}
+	if (cpu->proc != NULL) {
+		fprintf(krnl->out, "\tCPU %d: Put process %2d to run queue\n",
+			id, cpu->proc->pid);
+		put_proc(cpu->proc);
+	}
+	cpu->proc = NULL;
+	fprintf(krnl->out, "\tCPU %d offline\n", id);
+	return 0;
+}
+
+/* Retire the next [gap] slots of [cpu] in one step, between the
+ * detailed windows of a sampled run. Scheduling is approximated: the
+ * CPU only switches processes as their quantum ends or they finish,
+ * and does not see the arrivals of the gap before it is over. Return
+ * the slots used, fewer if the CPU is left without a process */
+static uint64_t cpu_forward(struct cpu_args * cpu, uint64_t gap) {
+	struct krnl_t * krnl = &cpu->os->krnl;
+	uint64_t now = current_time(krnl->timer);
+	uint64_t used = 0;
+
+	while (used < gap) {
+		if (cpu->proc->pc == cpu->proc->code->size) {
+			fprintf(krnl->out, "\tCPU %d: Processed %2d has finished\n",
+				cpu->id, cpu->proc->pid);
+			stats_finish(krnl->stats, cpu->proc, now + used);
+			evlog_finish(krnl->evlog, cpu->proc);
+			finish_proc(cpu->proc);
+			unload(cpu->proc);
+			cpu->proc = get_proc(krnl);
+			cpu->time_left = 0;
+		}else if (cpu->time_left == 0) {
+			put_proc(cpu->proc);
+			cpu->proc = get_proc(krnl);
+		}
+		if (cpu->proc == NULL)
+			break;
+		if (cpu->time_left == 0)
+			cpu->time_left = cpu->os->time_slot;
+
+		uint32_t n = fast_forward(cpu->proc,
+			gap - used < (uint64_t)cpu->time_left ?
+			gap - used : cpu->time_left);
+		cpu->proc->cpu_time += n;
+		cpu->time_left -= n;
+		cpu->forwarded += n;
+		used += n;
+	}
+	return used;
+}
+
+/* Slots an idle CPU sleeps through before it looks for a process
+ * again: this one, or between the windows of a sampled run, up to the
+ * next arrival or window */
+static uint64_t cpu_idle(struct os_t * os) {
+	uint64_t now = current_time(os->krnl.timer);
+	uint64_t gap = stats_gap(os->krnl.stats, now);
+
+	/* The loader may not have admitted those due by now yet */
+	if (gap == 0 || os->ld_due <= now)
+		return 1;
+	return os->ld_due - now < gap ? os->ld_due - now : gap;
+}
 
 static void * cpu_routine(void * args) {
-	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
-	int id = ((struct cpu_args*)args)->id;
-	/* Check for new process in ready queue */
-	int time_left = 0;
-	struct pcb_t * proc = NULL;
+	struct cpu_args * cpu = (struct cpu_args*)args;
+	struct os_t * os = cpu->os;
+	struct krnl_t * krnl = &os->krnl;
+	struct timer_id_t * timer_id = cpu->timer_id;
+	int id = cpu->id;
+	/* A CPU restored asleep sleeps on, see timer_at() */
+	if (cpu->skip > 0) {
+		uint64_t skip = cpu->skip;
+		cpu->skip = 0;
+		next_slots(timer_id, skip);
+	}
 	while (1) {
+		timer_turn(timer_id);
+		pthread_mutex_lock(&os->hotplug_lock);
+		if (cpu->state == CPU_DYING && cpu_leave(cpu) == 0)
+			break;	/* With hotplug_lock, see below */
+		pthread_mutex_unlock(&os->hotplug_lock);
 		/* Check the status of current process */
-		if (proc == NULL) {
+		if (cpu->proc == NULL) {
 			/* No process is running, the we load new process from
 		 	* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
+			cpu->proc = get_proc(krnl);
+			if (cpu->proc == NULL && !os->done) {
+                           next_slots(timer_id, cpu_idle(os));
                            continue; /* First load failed. skip dummy load */
                         }
-		}else if (proc->pc == proc->code->size) {
+		}else if (cpu->proc->pc == cpu->proc->code->size) {
 			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
+			fprintf(krnl->out, "\tCPU %d: Processed %2d has finished\n",
+				id ,cpu->proc->pid);
+			stats_finish(krnl->stats, cpu->proc, current_time(krnl->timer));
+			evlog_finish(krnl->evlog, cpu->proc);
+			finish_proc(cpu->proc);
+			unload(cpu->proc);
+			cpu->proc = get_proc(krnl);
+			cpu->time_left = 0;
+		}else if (cpu->time_left == 0) {
 			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
+			fprintf(krnl->out, "\tCPU %d: Put process %2d to run queue\n",
+				id, cpu->proc->pid);
+			put_proc(cpu->proc);
+			cpu->proc = get_proc(krnl);
 		}
 		
 		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
-			break;
-		}else if (proc == NULL) {
+		if (cpu->proc == NULL && os->done) {
+			/* No process to run, exit. A CPU going offline may
+			 * hand one over up to then, see cpu_leave() */
+			pthread_mutex_lock(&os->hotplug_lock);
+			cpu->proc = get_proc(krnl);
+			if (cpu->proc == NULL) {
+				fprintf(krnl->out, "\tCPU %d stopped\n", id);
+				break;
+			}
+			pthread_mutex_unlock(&os->hotplug_lock);
+		}
+		if (cpu->proc == NULL) {
 			/* There may be new processes to run in
 			 * next time slots, just skip current slot */
-			next_slot(timer_id);
+			next_slots(timer_id, cpu_idle(os));
 			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			time_left = time_slot;
+		}else if (cpu->time_left == 0) {
+			fprintf(krnl->out, "\tCPU %d: Dispatched process %2d\n",
+				id, cpu->proc->pid);
+			cpu->time_left = os->time_slot;
 		}
 		
-		/* Run current process */
-		run(proc);
-		time_left--;
+		/* Between the detailed windows of a sampled run, the CPU
+		 * sleeps through the whole gap at once, see cpu_forward() */
+		uint64_t gap = stats_gap(krnl->stats, current_time(krnl->timer));
+		if (gap > 0) {
+			uint64_t used = cpu_forward(cpu, gap);
+			next_slots(timer_id, used > 0 ? used : 1);
+			continue;
+		}
+
+		/* A run of CALC only uses the CPU, nothing else can observe
+		 * it. Retire as much of it as the quantum allows in one
+		 * step and sleep through the matching number of slots */
+		uint32_t burst = calc_burst(cpu->proc, cpu->time_left);
+		if (burst > 1) {
+			timer_pass(timer_id);
+			run_n(cpu->proc, burst);
+			cpu->proc->cpu_time += burst;
+			cpu->time_left -= burst;
+			cpu->detailed += burst;
+			next_slots(timer_id, burst);
+			continue;
+		}
+
+		/* Run current process. Its turn only orders the scheduling
+		 * above, unless the instruction touches memory or makes a
+		 * system call: the next CPUs need not wait for the rest */
+		if (private_step(cpu->proc))
+			timer_pass(timer_id);
+		run(cpu->proc);
+		cpu->proc->cpu_time++;
+		cpu->time_left--;
+		cpu->detailed++;
 		next_slot(timer_id);
 	}
+	/* Left with hotplug_lock held, so that no process is handed over
+	 * to a CPU that has stopped */
 	detach_event(timer_id);
+	if (cpu->state == CPU_ONLINE)
+		os->nr_active--;
+	cpu->state = CPU_OFFLINE;
+	os->nr_running--;
+	pthread_cond_broadcast(&os->hotplug_cond);
+	pthread_mutex_unlock(&os->hotplug_lock);
 	pthread_exit(NULL);
 }
 
-static void * ld_routine(void * args) {
-#ifdef MM_PAGING
-	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
-	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
-	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
-	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
+/* Start the thread of an already attached CPU, hotplug_lock held */
+static int cpu_start(struct cpu_args * cpu) {
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	cpu->state = CPU_ONLINE;
+	cpu->os->nr_active++;
+	cpu->os->nr_running++;
+	if (pthread_create(&thread, &attr, cpu_routine, (void*)cpu)) {
+		detach_event(cpu->timer_id);
+		cpu->state = CPU_OFFLINE;
+		cpu->os->nr_active--;
+		cpu->os->nr_running--;
+		pthread_attr_destroy(&attr);
+		return -1;
+	}
+	pthread_attr_destroy(&attr);
+	return 0;
+}
+
+int cpu_online(struct krnl_t * krnl, int id) {
+	struct os_t * os = (struct os_t *)krnl;
+	struct cpu_args * cpu;
+	int ret = -1;
+	if (id < 0 || id >= MAX_CPU)
+		return -1;
+	cpu = &os->cpus[id];
+	pthread_mutex_lock(&os->hotplug_lock);
+	/* A dying CPU must leave before its id can be reused */
+	if (cpu->state == CPU_OFFLINE) {
+		cpu->id = id;
+		cpu->os = os;
+		cpu->proc = NULL;
+		cpu->time_left = 0;
+		cpu->timer_id = attach_event(krnl->timer, TURN_CPU(id));
+		ret = cpu_start(cpu);
+		if (ret == 0)
+			fprintf(krnl->out, "\tCPU %d online at time slot %lu\n",
+				id, (unsigned long)current_time(krnl->timer));
+	}
+	pthread_mutex_unlock(&os->hotplug_lock);
+	return ret;
+}
+
+int cpu_offline(struct krnl_t * krnl, int id) {
+	struct os_t * os = (struct os_t *)krnl;
+	struct cpu_args * cpu;
+	int ret = -1;
+	if (id < 0 || id >= MAX_CPU)
+		return -1;
+	cpu = &os->cpus[id];
+	pthread_mutex_lock(&os->hotplug_lock);
+	/* Never take the last CPU away, its processes would be stranded */
+	if (cpu->state == CPU_ONLINE && os->nr_active > 1) {
+		cpu->state = CPU_DYING;
+		os->nr_active--;
+		fprintf(krnl->out, "\tCPU %d going offline at time slot %lu\n",
+			id, (unsigned long)current_time(krnl->timer));
+		ret = 0;
+	}
+	pthread_mutex_unlock(&os->hotplug_lock);
+	return ret;
+}
+
+static void * hp_routine(void * args) {
+	struct os_t * os = (struct os_t *)args;
+	struct timer_id_t * timer_id = os->hp_event;
+	for (; os->hp_next < os->num_hp_events; os->hp_next++) {
+		struct hotplug_event * e = &os->hp_events[os->hp_next];
+		uint64_t now = current_time(os->krnl.timer);
+		if (now < e->time)
+			next_slots(timer_id, e->time - now);
+		timer_turn(timer_id);
+		if (e->online)
+			cpu_online(&os->krnl, e->id);
+		else
+			cpu_offline(&os->krnl, e->id);
+	}
+	detach_event(timer_id);
+	pthread_exit(NULL);
+}
+
+/* Loader pipeline. Workers read upcoming arrivals and prepare their
+ * PCB and memory ahead of time, at most LOADER_AHEAD of them past the
+ * last admitted one, so that arrival i lives in ld_ring[i % LOADER_AHEAD]
+ * from the time it is read until it is admitted. The timeline thread
+ * (ld_routine) only hands ready PCBs to the scheduler at their arrival
+ * slot. Memory stays bounded however many processes go through */
+static struct pcb_t ld_rejected;	/* Marks arrivals that failed to load */
+#define LD_REJECTED	(&ld_rejected)
+
+/* Shared by all the simulations, the slab caches are never destroyed */
+static struct kmem_cache * mm_cache;
+static pthread_once_t mm_once = PTHREAD_ONCE_INIT;
+
+static void mm_cache_create(void) {
+	mm_cache = kmem_cache_create("mm_struct", sizeof(struct mm_struct));
+}
+
+/* Parse one arrival record: [time] [program] [priority], the last one
+ * only with MLQ_SCHED. Return 0 on success */
+static int scan_arrival(FILE * file, struct ld_arrival * a) {
+	char proc[88];
+	int n;
+
+	a->prio = 0;
+	a->job = 0;
+#ifdef MLQ_SCHED
+	n = fscanf(file, "%lu %87s %lu", &a->start_time, proc, &a->prio);
+	if (n != 3)
 #else
-	struct timer_id_t * timer_id = (struct timer_id_t*)args;
+	n = fscanf(file, "%lu %87s", &a->start_time, proc);
+	if (n != 2)
 #endif
-	int i = 0;
-	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
-		struct krnl_t * krnl = proc->krnl = &os;	
+	{
+		if (n != EOF)
+			printf("Malformed arrival record, end of arrivals\n");
+		return -1;
+	}
+	snprintf(a->path, sizeof(a->path), "input/proc/%s", proc);
+	return 0;
+}
+
+/* xorshift64*, uniform in (0, 1] */
+static double ol_unit(struct os_t * os) {
+	os->ol_seed ^= os->ol_seed >> 12;
+	os->ol_seed ^= os->ol_seed << 25;
+	os->ol_seed ^= os->ol_seed >> 27;
+	return (((os->ol_seed * 0x2545F4914F6CDD1DULL) >> 11) + 1) *
+		(1.0 / 9007199254740992.0);
+}
+
+static int poisson_arrival(struct os_t * os, struct ld_arrival * a) {
+	if (os->ol_catalogue == NULL) {
+		os->ol_catalogue = malloc(sizeof(struct ld_arrival) *
+					  (os->num_processes + 1));
+		while (os->ol_size < os->num_processes &&
+		       scan_arrival(os->ld_config,
+				    &os->ol_catalogue[os->ol_size]) == 0)
+			os->ol_size++;
+	}
+	if (os->ol_size == 0 || os->ol_drawn == os->ol_count)
+		return -1;
+	if (os->ol_drawn++ > 0)
+		os->ol_time += -log(ol_unit(os)) / os->ol_rate;
+	*a = os->ol_catalogue[(unsigned long)(ol_unit(os) * os->ol_size) %
+			      os->ol_size];
+	a->start_time = (unsigned long)os->ol_time;
+	return 0;
+}
+
+/* Read the next arrival, called with ld_src_lock held. Reading the
+ * stream blocks until a record or the end of the stream comes */
+static int read_arrival(struct os_t * os, struct ld_arrival * a) {
+	if (os->ol_rate > 0 && os->listed == 0) {
+		if (poisson_arrival(os, a) == 0)
+			return 0;
+		os->listed = os->num_processes;
+	}
+	if (os->ld_trace != NULL && os->listed == 0) {
+		struct trace_job job;
+
+		if (trace_next(os->ld_trace, &job) == 0) {
+			a->start_time = job.arrival;
+			a->prio = job.prio;
+			a->job = 1;
+			a->burst = job.burst;
+			a->mem = job.mem;
+			snprintf(a->path, sizeof(a->path), "%s#%lu",
+				 os->ld_trace_path, ++os->ld_jobs);
+			return 0;
+		}
+		os->listed = os->num_processes;
+	}
+	if (os->listed < os->num_processes) {
+		os->listed++;
+		if (scan_arrival(os->ld_config, a) == 0)
+			return 0;
+		os->listed = os->num_processes;
+	}
+	if (os->ld_stream != NULL)
+		return scan_arrival(os->ld_stream, a);
+	return -1;
+}
+
+/* Read the next arrival and prepare it. Return -1 once there is none */
+static int ld_prepare(struct os_t * os) {
+	/* Arrivals are read in order, one worker at a time */
+	pthread_mutex_lock(&os->ld_src_lock);
+	pthread_mutex_lock(&os->ld_lock);
+	while (!os->ld_end &&
+	       os->ld_next >= os->ld_admitted + LOADER_AHEAD)
+		pthread_cond_wait(&os->ld_cond, &os->ld_lock);
+	int i = os->ld_next;
+	pthread_mutex_unlock(&os->ld_lock);
+	struct ld_arrival * a = &os->ld_ring[i % LOADER_AHEAD];
+	int end = os->ld_end || (os->limit && i >= os->limit) ||
+		  read_arrival(os, a) != 0;
+
+	pthread_mutex_lock(&os->ld_lock);
+	if (end) {
+		os->ld_end = 1;
+	}else{
+		a->proc = NULL;
+		os->ld_next++;
+	}
+	pthread_cond_broadcast(&os->ld_cond);
+	pthread_mutex_unlock(&os->ld_lock);
+	pthread_mutex_unlock(&os->ld_src_lock);
+	if (end)
+		return -1;
 
+	struct pcb_t * proc;
+	if (!a->job)
+		proc = load(a->path);
+	else if (a->burst <= UINT32_MAX)
+		proc = load_job(a->burst, a->mem, a->prio);
+	else
+		proc = NULL;
+	if (proc == NULL) {
+		proc = LD_REJECTED;
+	}else{
+		proc->krnl = &os->krnl;
 #ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
+		proc->prio = a->prio;
 #endif
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
-		}
 #ifdef MM_PAGING
-		krnl->mm = malloc(sizeof(struct mm_struct));
-		init_mm(krnl->mm, proc);
-		krnl->mram = mram;
-		krnl->mswp = mswp;
-		krnl->active_mswp = active_mswp;
+		proc->mm = kmem_cache_alloc(mm_cache);
+		init_mm(proc->mm, proc);
 #endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
+	}
+	pthread_mutex_lock(&os->ld_lock);
+	a->proc = proc;
+	pthread_cond_broadcast(&os->ld_cond);
+	pthread_mutex_unlock(&os->ld_lock);
+	return 0;
+}
+
+static void * ld_worker(void * args) {
+	struct os_t * os = (struct os_t *)args;
+	while (ld_prepare(os) == 0)
+		;
+	return NULL;
+}
+
+/* Wait until arrival [i] is read. Return its arrival time in [time], or
+ * -1 if there is none */
+static int ld_peek(struct os_t * os, int i, unsigned long * time) {
+	int found;
+
+	/* Without workers, arrivals are prepared as they are needed, in
+	 * the turn of the loader as they may log */
+	while (os->ld_workers == 0 && i >= os->ld_next && !os->ld_end) {
+		timer_turn(os->ld_event);
+		ld_prepare(os);
+	}
+	pthread_mutex_lock(&os->ld_lock);
+	while (i >= os->ld_next && !os->ld_end)
+		pthread_cond_wait(&os->ld_cond, &os->ld_lock);
+	found = i < os->ld_next;
+	if (found)
+		*time = os->ld_ring[i % LOADER_AHEAD].start_time;
+	pthread_mutex_unlock(&os->ld_lock);
+	return found ? 0 : -1;
+}
+
+static void * ld_routine(void * args) {
+	struct os_t * os = (struct os_t *)args;
+	struct krnl_t * krnl = &os->krnl;
+	struct timer_id_t * timer_id = os->ld_event;
+	pthread_t workers[LOADER_WORKERS];
+	unsigned long start_time;
+	int i = os->ld_admitted;	/* Past those of a snapshot */
+	int w;
+	timer_turn(timer_id);
+	/* A restored run printed it before its snapshot */
+	if (!os->restored)
+		fprintf(krnl->out, "ld_routine\n");
+	pthread_once(&mm_once, mm_cache_create);
+	/* A deterministic run prepares them itself, see ld_peek() */
+	if (!os->deterministic)
+		os->ld_workers = LOADER_WORKERS;
+	for (w = 0; w < os->ld_workers; w++)
+		pthread_create(&workers[w], NULL, ld_worker, os);
+
+	/* The clock does not go past a slot before the arrival following
+	 * it is known, so a stream is replayed the same however slowly
+	 * its records come */
+	while (ld_peek(os, i, &start_time) == 0) {
+		uint64_t now = current_time(krnl->timer);
+		os->ld_due = start_time;
+		if (now < start_time)
+			next_slots(timer_id, start_time - now);
+		timer_turn(timer_id);
+		/* Admit every process arriving in this slot. The slot does
+		 * not end before they are ready */
+		while (ld_peek(os, i, &start_time) == 0 &&
+		       start_time <= current_time(krnl->timer)) {
+			struct ld_arrival * a = &os->ld_ring[i % LOADER_AHEAD];
+			char path[sizeof(a->path)];
+			unsigned long prio = a->prio;
+
+			strcpy(path, a->path);
+			pthread_mutex_lock(&os->ld_lock);
+			while (a->proc == NULL)
+				pthread_cond_wait(&os->ld_cond, &os->ld_lock);
+			struct pcb_t * proc = a->proc;
+			os->ld_admitted = i + 1;
+			pthread_cond_broadcast(&os->ld_cond);
+			pthread_mutex_unlock(&os->ld_lock);
+			i++;
+			/* Reported on arrival rather than when prepared
+			 * ahead, so once in a restored run too */
+			if (proc == LD_REJECTED) {
+				fprintf(krnl->out, "\tRejected a process at %s:"
+					" invalid program\n", path);
+				continue;
+			}
+
+			proc->pid = os->avail_pid++;
+			stats_arrival(krnl->stats, proc,
+				      current_time(krnl->timer));
+			evlog_admit(krnl->evlog, proc);
+#ifdef MM_PAGING
+			krnl->mm = proc->mm;
+#endif
+			fprintf(krnl->out,
+				"\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+				path, proc->pid, prio);
+			add_proc(proc);
+		}
 		next_slot(timer_id);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	os->ld_due = UINT64_MAX;
+	for (w = 0; w < os->ld_workers; w++)
+		pthread_join(workers[w], NULL);
+	os->done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
-static void read_config(const char * path) {
+static int read_config(struct os_t * os, const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
 		printf("Cannot find configure file at %s\n", path);
-		exit(1);
+		return -1;
 	}
-	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
+	fscanf(file, "%d %d %d\n", &os->time_slot, &os->num_cpus,
+		&os->num_processes);
 #ifdef MM_PAGING
 	int sit;
 #ifdef MM_FIXED_MEMSZ
@@ -161,119 +702,779 @@ static void read_config(const char * path) {
 	 * for legacy info 
          *  [time slice] [N = Number of CPU] [M = Number of Processes to be run]
          */
-        memramsz    =  0x100000;
-        memswpsz[0] = 0x1000000;
+        os->memramsz    =  0x100000;
+        os->memswpsz[0] = 0x1000000;
 	for(sit = 1; sit < PAGING_MAX_MMSWP; sit++)
-		memswpsz[sit] = 0;
+		os->memswpsz[sit] = 0;
 #else
 	/* Read input config of memory size: MEMRAM and upto 4 MEMSWP (mem swap)
 	 * Format: (size=0 result non-used memswap, must have RAM and at least 1 SWAP)
 	 *        MEM_RAM_SZ MEM_SWP0_SZ MEM_SWP1_SZ MEM_SWP2_SZ MEM_SWP3_SZ
 	*/
-	fscanf(file, "%d\n", &memramsz);
+	fscanf(file, "%d\n", &os->memramsz);
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-		fscanf(file, "%d", &(memswpsz[sit])); 
+		fscanf(file, "%d", &(os->memswpsz[sit])); 
 
        fscanf(file, "\n"); /* Final character */
 #endif
 #endif
 
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
+	/* The process list is read by the loader as it goes. Skip it for
+	 * now to get to the hotplug timeline */
+	long list = ftell(file);
 	int i;
-	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
+	for (i = 0; i < os->num_processes; i++) {
 #ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
+		fscanf(file, "%*u %*s %*u");
 #else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+		fscanf(file, "%*u %*s");
 #endif
-		strcat(ld_processes.path[i], proc);
 	}
+	fscanf(file, "\n");
+
+	/* Optional CPU hotplug timeline following the process list
+	 * Format: [time] [online|offline] [CPU id]
+	 */
+	unsigned long hp_time;
+	char hp_op[16];
+	int hp_id;
+	while (fscanf(file, "%lu %15s %d\n", &hp_time, hp_op, &hp_id) == 3) {
+		os->hp_events = realloc(os->hp_events,
+			sizeof(struct hotplug_event) * (os->num_hp_events + 1));
+		os->hp_events[os->num_hp_events].time = hp_time;
+		os->hp_events[os->num_hp_events].id = hp_id;
+		os->hp_events[os->num_hp_events].online = !strcmp(hp_op, "online");
+		os->num_hp_events++;
+	}
+	fseek(file, list, SEEK_SET);
+	os->ld_config = file;
+	return 0;
 }
 
-int main(int argc, char * argv[]) {
-	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
-		return 1;
+/* Open what the run reads and writes besides its configure file */
+static int open_sources(struct os_t * os, const struct os_opts * opts) {
+	if (opts->record != NULL &&
+	    (os->krnl.evlog = evlog_open(opts->record, os->num_cpus,
+					 os->time_slot)) == NULL) {
+		printf("Cannot create event log %s\n", opts->record);
+		return -1;
+	}
+	if (os->ld_trace_path != NULL &&
+	    (os->ld_trace = trace_open(os->ld_trace_path)) == NULL) {
+		printf("Cannot open trace %s\n", os->ld_trace_path);
+		return -1;
+	}
+	if (opts->stream != NULL) {
+		if (!strcmp(opts->stream, "-")) {
+			os->ld_stream = stdin;
+		}else if ((os->ld_stream = fopen(opts->stream, "r")) == NULL) {
+			printf("Cannot open arrival stream %s\n", opts->stream);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void os_free(struct os_t * os) {
+	if (os->ld_config != NULL)
+		fclose(os->ld_config);
+	if (os->ld_trace != NULL)
+		trace_close(os->ld_trace);
+	if (os->ld_stream != NULL && os->ld_stream != stdin)
+		fclose(os->ld_stream);
+	evlog_close(os->krnl.evlog);
+	free(os->ol_catalogue);
+	free(os->hp_events);
+	pthread_mutex_destroy(&os->hotplug_lock);
+	pthread_cond_destroy(&os->hotplug_cond);
+	pthread_mutex_destroy(&os->ld_lock);
+	pthread_cond_destroy(&os->ld_cond);
+	pthread_mutex_destroy(&os->ld_src_lock);
+	stats_destroy(&os->stats);
+#ifdef MM_PAGING
+	pthread_mutex_destroy(&os->krnl.mmvm_lock);
+#endif
+	free(os);
+}
+
+/* Snapshots, see ckpt.h. After the header: the slot, workload and
+ * settings of the run, the loader, the statistics, the memory of the
+ * processes, the processes, the CPUs, the ready queues and the memory
+ * devices */
+
+static void put_name(struct ckpt * ck, const char * name) {
+	char buf[100] = {0};
+
+	if (name != NULL)
+		snprintf(buf, sizeof(buf), "%s", name);
+	CKPT_PUT(ck, buf);
+}
+
+static int get_name(struct ckpt * ck, char * buf) {
+	if (ckpt_get(ck, buf, 100) != 0)
+		return -1;
+	buf[99] = '\0';
+	return 0;
+}
+
+static void put_stats(struct ckpt * ck, struct stats_t * stats) {
+	pthread_mutex_lock(&stats->lock);
+	CKPT_PUT(ck, stats->hist);
+	CKPT_PUT(ck, stats->admitted);
+	CKPT_PUT(ck, stats->finished);
+	CKPT_PUT(ck, stats->first_arrival);
+	CKPT_PUT(ck, stats->last_arrival);
+	CKPT_PUT(ck, stats->last_finish);
+	CKPT_PUT(ck, stats->total);
+	pthread_mutex_unlock(&stats->lock);
+}
+
+static void get_stats(struct ckpt * ck, struct stats_t * stats) {
+	CKPT_GET(ck, stats->hist);
+	CKPT_GET(ck, stats->admitted);
+	CKPT_GET(ck, stats->finished);
+	CKPT_GET(ck, stats->first_arrival);
+	CKPT_GET(ck, stats->last_arrival);
+	CKPT_GET(ck, stats->last_finish);
+	CKPT_GET(ck, stats->total);
+}
+
+static void put_pcb(struct ckpt * ck, const struct pcb_t * proc, int32_t mm) {
+	CKPT_PUT(ck, proc->path);
+	CKPT_PUT(ck, proc->pid);
+	CKPT_PUT(ck, proc->priority);
+#ifdef MLQ_SCHED
+	CKPT_PUT(ck, proc->prio);
+#endif
+	CKPT_PUT(ck, proc->regs);
+	CKPT_PUT(ck, proc->pc);
+	CKPT_PUT(ck, proc->bp);
+	CKPT_PUT(ck, proc->arrival);
+	CKPT_PUT(ck, proc->cpu_time);
+	CKPT_PUT(ck, mm);
+}
+
+/* A process of a snapshot, its program loaded again. [mms] are the
+ * memories it may have */
+static struct pcb_t * get_pcb(struct ckpt * ck, struct mm_struct ** mms,
+		int nmm) {
+	char path[sizeof(((struct pcb_t *)0)->path)];
+	struct pcb_t * proc;
+	int32_t mm = -1;
+
+	if (ckpt_get(ck, path, sizeof(path)) != 0)
+		return NULL;
+	path[sizeof(path) - 1] = '\0';
+	if ((proc = reload(path)) == NULL) {
+		printf("Cannot load %s again\n", path);
+		return NULL;
+	}
+	CKPT_GET(ck, proc->pid);
+	CKPT_GET(ck, proc->priority);
+#ifdef MLQ_SCHED
+	CKPT_GET(ck, proc->prio);
+#endif
+	CKPT_GET(ck, proc->regs);
+	CKPT_GET(ck, proc->pc);
+	CKPT_GET(ck, proc->bp);
+	CKPT_GET(ck, proc->arrival);
+	CKPT_GET(ck, proc->cpu_time);
+	if (CKPT_GET(ck, mm) != 0 || mm >= nmm ||
+	    proc->pc > proc->code->size) {
+		/* Or the program changed since */
+		unload(proc);
+		return NULL;
+	}
+	proc->mm = mm >= 0 ? mms[mm] : NULL;
+	return proc;
+}
+
+static int mm_index(struct mm_struct ** mms, int nmm, struct mm_struct * mm) {
+	int i;
+
+	for (i = 0; mm != NULL && i < nmm; i++) {
+		if (mms[i] == mm)
+			return i;
+	}
+	return -1;
+}
+
+/* Write the snapshot of the run at the start of the current slot. Every
+ * thread of the run but the loader workers waits meanwhile, see
+ * timer_at() */
+static void os_checkpoint(void * arg) {
+	struct os_t * os = (struct os_t *)arg;
+	struct krnl_t * krnl = &os->krnl;
+	uint64_t time = current_time(krnl->timer);
+	struct mm_struct ** mms;
+	struct ckpt * ck;
+	int32_t i, n, nmm = 0;
+
+	if ((ck = ckpt_create(os->ck_path)) == NULL) {
+		fprintf(krnl->out, "Cannot create snapshot %s\n", os->ck_path);
+		return;
+	}
+	CKPT_PUT(ck, time);
+	put_name(ck, os->config);
+	put_name(ck, os->ld_trace_path);
+	CKPT_PUT(ck, os->ol_rate);
+	CKPT_PUT(ck, os->ol_count);
+	CKPT_PUT(ck, os->seed);
+	CKPT_PUT(ck, os->limit);
+	CKPT_PUT(ck, os->time_slot);
+	CKPT_PUT(ck, os->num_cpus);
+	CKPT_PUT(ck, os->policy);
+	CKPT_PUT(ck, os->budget);
+
+	pthread_mutex_lock(&os->ld_lock);
+	CKPT_PUT(ck, os->ld_admitted);
+	pthread_mutex_unlock(&os->ld_lock);
+	CKPT_PUT(ck, os->avail_pid);
+	CKPT_PUT(ck, os->done);
+	CKPT_PUT(ck, os->hp_next);
+	put_stats(ck, &os->stats);
+
+	/* The processes on a CPU, then the queued ones, and their memory.
+	 * A finished process may still have its memory in use by the
+	 * kernel, see libmem.c */
+	for (i = 0; i < MAX_CPU; i++) {
+		if (os->cpus[i].state != CPU_OFFLINE && os->cpus[i].proc != NULL)
+			ckpt_add_proc(ck, os->cpus[i].proc);
+	}
+	sched_list(krnl, ck);
+	n = ckpt_nprocs(ck);
+	mms = (struct mm_struct **)malloc(sizeof(*mms) * (n + 1));
+#ifdef MM_PAGING
+	for (i = 0; i <= n; i++) {
+		struct mm_struct * mm = i < n ? ckpt_proc(ck, i)->mm :
+						krnl->mm;
+		if (mm != NULL && mm_index(mms, nmm, mm) < 0)
+			mms[nmm++] = mm;
+	}
+#endif
+	CKPT_PUT(ck, nmm);
+#ifdef MM_PAGING
+	for (i = 0; i < nmm; i++)
+		ckpt_put_mm(ck, mms[i]);
+#endif
+	CKPT_PUT(ck, n);
+	for (i = 0; i < n; i++) {
+		struct pcb_t * proc = ckpt_proc(ck, i);
+		put_pcb(ck, proc, mm_index(mms, nmm, proc->mm));
+	}
+
+	/* A CPU whose thread is over is offline, whatever its state */
+	pthread_mutex_lock(&os->hotplug_lock);
+	for (i = 0; i < MAX_CPU; i++) {
+		struct cpu_args * cpu = &os->cpus[i];
+		int32_t state = cpu->state;
+		uint64_t skip = 0;
+
+		if (state != CPU_OFFLINE && cpu->timer_id->fsh)
+			state = CPU_OFFLINE;
+		if (state != CPU_OFFLINE)
+			skip = cpu->timer_id->skip;
+		CKPT_PUT(ck, state);
+		ckpt_put_proc(ck, state != CPU_OFFLINE ? cpu->proc : NULL);
+		CKPT_PUT(ck, cpu->time_left);
+		CKPT_PUT(ck, skip);
+	}
+	pthread_mutex_unlock(&os->hotplug_lock);
+	sched_save(krnl, ck);
+
+#ifdef MM_PAGING
+	i = mm_index(mms, nmm, krnl->mm);
+	CKPT_PUT(ck, i);
+	CKPT_PUT(ck, krnl->active_mswp_id);
+	ckpt_put_memphy(ck, &os->mram);
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		ckpt_put_memphy(ck, &os->mswp[i]);
+#endif
+	free(mms);
+
+	if (ckpt_close(ck) != 0) {
+		fprintf(krnl->out, "Cannot write snapshot %s\n", os->ck_path);
+		return;
+	}
+	os->ck_written = 1;
+	fprintf(krnl->out, "Snapshot of time slot %lu written to %s\n",
+		(unsigned long)time, os->ck_path);
+}
+
+/* Read the slot, workload and settings of the snapshot [ck] into [time]
+ * and [ro], with the settings of [opts] a restored run may change.
+ * Return 0 on success */
+static int restore_opts(struct os_t * os, struct ckpt * ck,
+		const struct os_opts * opts, struct os_opts * ro,
+		uint64_t * time) {
+	int time_slot, num_cpus, policy, budget;
+
+	*ro = *opts;
+	CKPT_GET(ck, *time);
+	get_name(ck, os->ck_names[0]);
+	get_name(ck, os->ck_names[1]);
+	CKPT_GET(ck, ro->rate);
+	CKPT_GET(ck, ro->count);
+	CKPT_GET(ck, ro->seed);
+	CKPT_GET(ck, ro->limit);
+	CKPT_GET(ck, time_slot);
+	CKPT_GET(ck, num_cpus);
+	CKPT_GET(ck, policy);
+	if (CKPT_GET(ck, budget) != 0)
+		return -1;
+
+	if (opts->config != NULL && strcmp(opts->config, os->ck_names[0])) {
+		printf("Snapshot %s is of %s\n", opts->restore, os->ck_names[0]);
+		return -1;
+	}
+	if (opts->cpus > 0 || opts->memramsz > 0 || opts->memswpsz > 0) {
+		printf("A restored run keeps the CPUs and memory of its"
+		       " snapshot\n");
+		return -1;
+	}
+	if (opts->policy != policy) {
+		printf("Snapshot %s was taken with the %s policy\n",
+		       opts->restore, sched_policy_name(policy));
+		return -1;
+	}
+	ro->config = os->ck_names[0];
+	ro->trace = os->ck_names[1][0] ? os->ck_names[1] : NULL;
+	ro->cpus = num_cpus;
+	if (opts->time_slot == 0)
+		ro->time_slot = time_slot;
+	if (opts->budget == 0)
+		ro->budget = budget;
+	if (opts->limit > 0)
+		ro->limit = opts->limit;
+	return 0;
+}
+
+/* Bring back the state of the snapshot [ck] and close it. [boot] gets
+ * the state of each CPU. Return 0 on success */
+static int os_restore(struct os_t * os, struct ckpt * ck, int * boot) {
+	struct krnl_t * krnl = &os->krnl;
+	struct mm_struct ** mms = NULL;
+	struct pcb_t ** procs = NULL;
+	struct ld_arrival a;
+	int32_t i, n = 0, nmm = 0, state;
+
+	CKPT_GET(ck, os->ld_admitted);
+	CKPT_GET(ck, os->avail_pid);
+	CKPT_GET(ck, os->done);
+	CKPT_GET(ck, os->hp_next);
+	get_stats(ck, &os->stats);
+	init_scheduler(krnl, os->policy, os->budget);
+	if (os->hp_next < 0 || os->hp_next > os->num_hp_events)
+		goto fail;
+
+	if (CKPT_GET(ck, nmm) != 0 || nmm < 0 || nmm > CKPT_LIST_MAX)
+		goto fail;
+	mms = (struct mm_struct **)calloc(nmm + 1, sizeof(*mms));
+#ifdef MM_PAGING
+	pthread_once(&mm_once, mm_cache_create);
+	for (i = 0; i < nmm; i++) {
+		mms[i] = kmem_cache_alloc(mm_cache);
+		if (ckpt_get_mm(ck, mms[i]) != 0)
+			goto fail;
+	}
+#endif
+	if (CKPT_GET(ck, n) != 0 || n < 0 || n > CKPT_LIST_MAX)
+		goto fail;
+	procs = (struct pcb_t **)calloc(n + 1, sizeof(*procs));
+	for (i = 0; i < n; i++) {
+		struct pcb_t * proc = get_pcb(ck, mms, nmm);
+		if (proc == NULL)
+			goto fail;
+		proc->krnl = krnl;
+		ckpt_set_proc(ck, i, proc);
+		procs[i] = proc;
 	}
+
+	for (i = 0; i < MAX_CPU; i++) {
+		struct cpu_args * cpu = &os->cpus[i];
+
+		state = -1;
+		CKPT_GET(ck, state);
+		cpu->proc = ckpt_get_proc(ck);
+		CKPT_GET(ck, cpu->time_left);
+		CKPT_GET(ck, cpu->skip);
+		if (state < CPU_OFFLINE || state > CPU_DYING)
+			goto fail;
+		boot[i] = state;
+	}
+	if (sched_restore(krnl, ck) != 0)
+		goto fail;
+
+#ifdef MM_PAGING
+	CKPT_GET(ck, i);
+	krnl->mm = i >= 0 && i < nmm ? mms[i] : NULL;
+	CKPT_GET(ck, krnl->active_mswp_id);
+	if (krnl->active_mswp_id >= PAGING_MAX_MMSWP)
+		goto fail;
+	ckpt_get_memphy(ck, &os->mram);
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		ckpt_get_memphy(ck, &os->mswp[i]);
+#endif
+	state = ckpt_close(ck);
+	ck = NULL;
+	if (state != 0)
+		goto fail;
+	free(mms);
+	free(procs);
+
+	/* The arrivals admitted before are read again, but not loaded */
+	for (i = 0; i < os->ld_admitted && read_arrival(os, &a) == 0; i++)
+		;
+	os->ld_next = os->ld_admitted;
+	os->restored = 1;
+	return 0;
+
+fail:
+	/* The run does not start, release all that was restored */
+	if (ck != NULL)
+		ckpt_close(ck);
+	for (i = 0; i < MAX_CPU; i++)
+		os->cpus[i].proc = NULL;
+	for (i = 0; procs != NULL && procs[i] != NULL; i++)
+		unload(procs[i]);
+	finish_scheduler(krnl);
+#ifdef MM_PAGING
+	for (i = 0; mms != NULL && mms[i] != NULL; i++) {
+		ckpt_free_mm(mms[i]);
+		kmem_cache_free(mm_cache, mms[i]);
+	}
+	free_memphy(&os->mram);
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		free_memphy(&os->mswp[i]);
+#endif
+	free(procs);
+	free(mms);
+	return -1;
+}
+
+long os_workload(const struct os_opts * opts) {
+	char path[100];
+	int time_slot, num_cpus, num_processes;
+	FILE * file;
+
+	if (opts->trace != NULL || opts->stream != NULL || opts->config == NULL)
+		return -1;
+	snprintf(path, sizeof(path), "input/%s", opts->config);
+	if ((file = fopen(path, "r")) == NULL)
+		return -1;
+	if (fscanf(file, "%d %d %d", &time_slot, &num_cpus,
+		   &num_processes) != 3)
+		num_processes = -1;
+	fclose(file);
+	if (opts->rate > 0 && opts->count > 0)
+		return opts->count;
+	return num_processes;
+}
+
+int os_run(const struct os_opts * opts, struct stats_summary * sum) {
+	struct os_t * os = (struct os_t *)calloc(1, sizeof(struct os_t));
+	struct krnl_t * krnl = &os->krnl;
+	struct ckpt * ck = NULL;
+	struct os_opts ro;
+	uint64_t start = 0;
+	int boot[MAX_CPU] = {0};	/* State to start each CPU in */
 	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
-	strcat(path, argv[1]);
-	read_config(path);
-
-	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
-	struct cpu_args * args =
-		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
+	int i;
+
+	cpu_init();	/* Before any code is decoded */
+	krnl->out = opts->out != NULL ? opts->out : stdout;
+	krnl->stats = &os->stats;
+	stats_init(&os->stats);
+	pthread_mutex_init(&os->hotplug_lock, NULL);
+	pthread_cond_init(&os->hotplug_cond, NULL);
+	pthread_mutex_init(&os->ld_lock, NULL);
+	pthread_cond_init(&os->ld_cond, NULL);
+	pthread_mutex_init(&os->ld_src_lock, NULL);
+#ifdef MM_PAGING
+	pthread_mutex_init(&krnl->mmvm_lock, NULL);
+#endif
+	if (opts->restore != NULL) {
+		if ((ck = ckpt_open(opts->restore)) == NULL) {
+			printf("Cannot read snapshot %s\n", opts->restore);
+			os_free(os);
+			return -1;
+		}
+		if (restore_opts(os, ck, opts, &ro, &start) != 0) {
+			ckpt_close(ck);
+			os_free(os);
+			return -1;
+		}
+		opts = &ro;
+	}
+	os->config = opts->config;
+	os->ck_path = opts->checkpoint;
+	os->policy = opts->policy;
+	os->budget = opts->budget;
+	os->limit = opts->limit;
+	os->deterministic = opts->deterministic;
+	os->ld_trace_path = opts->trace;
+	os->ol_rate = opts->rate;
+	os->ol_count = opts->count;
+	os->ol_seed = opts->seed;
+	os->seed = opts->seed;
+	os->avail_pid = 1;
+
+	snprintf(path, sizeof(path), "input/%s", opts->config);
+	if (read_config(os, path) != 0) {
+		os_free(os);
+		return -1;
+	}
+	if (opts->time_slot > 0)
+		os->time_slot = opts->time_slot;
+	if (opts->cpus > 0)
+		os->num_cpus = opts->cpus;
+#ifdef MM_PAGING
+	if (opts->memramsz > 0)
+		os->memramsz = opts->memramsz;
+	if (opts->memswpsz > 0)
+		os->memswpsz[0] = opts->memswpsz;
+#endif
+	if (os->num_cpus > MAX_CPU) {
+		printf("At most %d CPUs are supported\n", MAX_CPU);
+		os_free(os);
+		return -1;
+	}
+	if (os->ol_rate > 0 && os->ol_count == 0)
+		os->ol_count = os->num_processes;
+	if (open_sources(os, opts) != 0) {
+		if (ck != NULL)
+			ckpt_close(ck);
+		os_free(os);
+		return -1;
+	}
+	if (ck != NULL && os_restore(os, ck, boot) != 0) {
+		printf("Cannot restore snapshot %s\n", opts->restore);
+		os_free(os);
+		return -1;
+	}
+	for (i = 0; ck == NULL && i < os->num_cpus; i++)
+		boot[i] = CPU_ONLINE;
+	if (opts->sample_period > 0)
+		stats_sample(&os->stats, opts->sample_detail,
+			     opts->sample_period, start);
+
 	pthread_t ld;
+	pthread_t hp;
 	
 	/* Init timer */
-	int i;
-	for (i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
-		args[i].id = i;
+	krnl->timer = timer_new(krnl->out);
+	timer_set(krnl->timer, start);
+	if (os->deterministic)
+		timer_ordered(krnl->timer);
+	if (os->ck_path != NULL)
+		timer_at(krnl->timer, opts->checkpoint_at, os_checkpoint, os);
+	for (i = 0; i < MAX_CPU; i++) {
+		if (boot[i] == CPU_OFFLINE)
+			continue;
+		os->cpus[i].timer_id = attach_event(krnl->timer, TURN_CPU(i));
+		os->cpus[i].id = i;
+		os->cpus[i].os = os;
 	}
-	struct timer_id_t * ld_event = attach_event();
-	start_timer();
+	os->ld_event = attach_event(krnl->timer, TURN_LOADER);
+	if (os->hp_next < os->num_hp_events)
+		os->hp_event = attach_event(krnl->timer, TURN_HOTPLUG);
+	if (opts->sample_period > 0)
+		timer_bulk(krnl->timer);
+	if (ck != NULL)
+		fprintf(krnl->out, "Restored %s at time slot %lu\n",
+			opts->restore, (unsigned long)start);
+	start_timer(krnl->timer);
 
 #ifdef MM_PAGING
 	/* Init all MEMPHY include 1 MEMRAM and n of MEMSWP */
 	int rdmflag = 1; /* By default memphy is RANDOM ACCESS MEMORY */
-
-	struct memphy_struct mram;
-	struct memphy_struct mswp[PAGING_MAX_MMSWP];
-
-	/* Create MEM RAM */
-	init_memphy(&mram, memramsz, rdmflag);
-
-        /* Create all MEM SWAP */ 
 	int sit;
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
 
-	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
-	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
+	/* A restored run has them from its snapshot */
+	if (ck == NULL) {
+		/* Create MEM RAM */
+		init_memphy(&os->mram, os->memramsz, rdmflag);
+
+		/* Create all MEM SWAP */
+		for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+			init_memphy(&os->mswp[sit], os->memswpsz[sit], rdmflag);
+		krnl->active_mswp_id = 0;
+	}
 
-	mm_ld_args->timer_id = ld_event;
-	mm_ld_args->mram = (struct memphy_struct *) &mram;
-	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
-	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
-        mm_ld_args->active_mswp_id = 0;
+	/* In Paging mode, every process reaches the system memory through
+	 * its kernel */
+	krnl->mram = &os->mram;
+	krnl->mswp = (struct memphy_struct **)&os->mswp;
+	krnl->active_mswp = &os->mswp[krnl->active_mswp_id];
 #endif
 
 	/* Init scheduler */
-	init_scheduler();
+	if (ck == NULL)
+		init_scheduler(krnl, os->policy, os->budget);
 
 	/* Run CPU and loader */
-#ifdef MM_PAGING
-	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
-#else
-	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
-#endif
-	for (i = 0; i < num_cpus; i++) {
-		pthread_create(&cpu[i], NULL,
-			cpu_routine, (void*)&args[i]);
+	pthread_create(&ld, NULL, ld_routine, (void*)os);
+	pthread_mutex_lock(&os->hotplug_lock);
+	for (i = 0; i < MAX_CPU; i++) {
+		if (boot[i] == CPU_OFFLINE)
+			continue;
+		cpu_start(&os->cpus[i]);
+		/* Restored on its way offline, it leaves at its next slot */
+		if (boot[i] == CPU_DYING && os->cpus[i].state == CPU_ONLINE) {
+			os->cpus[i].state = CPU_DYING;
+			os->nr_active--;
+		}
 	}
+	pthread_mutex_unlock(&os->hotplug_lock);
+	if (os->hp_event != NULL)
+		pthread_create(&hp, NULL, hp_routine, (void*)os);
 
-	/* Wait for CPU and loader finishing */
-	for (i = 0; i < num_cpus; i++) {
-		pthread_join(cpu[i], NULL);
+	/* Wait for CPU and loader finishing. Once the hotplug timeline is
+	 * over, new CPUs can only be brought up by a running one */
+	if (os->hp_event != NULL)
+		pthread_join(hp, NULL);
+	pthread_mutex_lock(&os->hotplug_lock);
+	while (os->nr_running > 0) {
+		pthread_cond_wait(&os->hotplug_cond, &os->hotplug_lock);
 	}
+	pthread_mutex_unlock(&os->hotplug_lock);
 	pthread_join(ld, NULL);
 
 	/* Stop timer */
-	stop_timer();
+	stop_timer(krnl->timer);
 
-	return 0;
+	/* A sampled run only reports what its windows tell, the rest of
+	 * the run was approximated */
+	if (opts->sample_period == 0 &&
+	    (os->ol_rate > 0 || os->ld_trace_path != NULL))
+		stats_report(&os->stats, krnl->out, os->ol_rate);
+	if (opts->sample_period > 0) {
+		uint64_t detailed = 0, forwarded = 0;
+		for (i = 0; i < MAX_CPU; i++) {
+			detailed += os->cpus[i].detailed;
+			forwarded += os->cpus[i].forwarded;
+		}
+		stats_sampled(&os->stats, krnl->out, detailed, forwarded);
+	}
+	if (sum != NULL)
+		stats_summary(&os->stats, os->ol_rate, sum);
+	if (os->ck_path != NULL && !os->ck_written)
+		fprintf(krnl->out, "No snapshot written to %s\n", os->ck_path);
+	/* A process left behind fails the run, its statistics are short */
+	uint64_t unfinished = os->stats.admitted - os->stats.finished;
+	if (unfinished > 0)
+		fprintf(krnl->out, "%lu processes did not finish\n",
+			(unsigned long)unfinished);
 
+	finish_scheduler(krnl);
+#ifdef MM_PAGING
+	free_memphy(&os->mram);
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+		free_memphy(&os->mswp[sit]);
+#endif
+	i = (os->ck_path != NULL && !os->ck_written) || unfinished > 0 ? -1 : 0;
+	os_free(os);
+	return i;
 }
 
+int main(int argc, char * argv[]) {
+	/* Read config. With -s, the processes it lists are followed by
+	 * the arrival records written to [stream], '-' for stdin. A
+	 * named FIFO keeps the simulation going until its writers leave.
+	 * With -r, [-n] processes drawn from that list arrive as a Poisson
+	 * process of [rate] per slot, and the run ends with a report.
+	 * With -T, the jobs of a recorded trace replace that list.
+	 * With -R, the run is recorded for replay, see evlog.h.
+	 * With -p, the scheduler runs another policy, see sched.h.
+	 * With -w, the run is repeated for every combination of the
+	 * values given to the settings named, [-j] runs at a time, and
+	 * only a line of statistics is printed for each, see os_sweep().
+	 * With -a, those settings (by default the slot and the MLQ
+	 * budget) are searched for the best mean or p99 turnaround or
+	 * throughput, see os_tune().
+	 * With -c, a snapshot of the run at the start of time slot [slot]
+	 * is written to [file]. With -x, the run goes on from one instead,
+	 * with the workload it was taken of, see ckpt.h.
+	 * With -f, only [detail] slots of every [period] are simulated in
+	 * detail and the statistics are extrapolated from them.
+	 * With -d, the run is deterministic: the same input gives the
+	 * same log and statistics, see timer_ordered() */
+	struct os_opts opts = {0};
+	char * axes[8];
+	int naxes = 0;
+	int jobs = 0;
+	int objective = -1;
+	int c;
+	opts.seed = 1;
+	opts.policy = SCHED_MLQ;
+	while ((c = getopt(argc, argv, "s:r:n:S:T:R:p:w:j:a:c:x:f:d")) != -1) {
+		if (c == 's') {
+			opts.stream = optarg;
+		}else if (c == 'R') {
+			opts.record = optarg;
+		}else if (c == 'T') {
+			opts.trace = optarg;
+		}else if (c == 'r') {
+			opts.rate = atof(optarg);
+		}else if (c == 'n') {
+			opts.count = strtoul(optarg, NULL, 10);
+		}else if (c == 'S') {
+			opts.seed = strtoull(optarg, NULL, 10);
+		}else if (c == 'p' && sched_policy(optarg) >= 0) {
+			opts.policy = sched_policy(optarg);
+		}else if (c == 'w' && naxes < 8) {
+			axes[naxes++] = optarg;
+		}else if (c == 'j') {
+			jobs = atoi(optarg);
+		}else if (c == 'a' && tune_objective(optarg) >= 0) {
+			objective = tune_objective(optarg);
+		}else if (c == 'c' && strchr(optarg, ':') != NULL) {
+			opts.checkpoint_at = strtoul(optarg, NULL, 10);
+			opts.checkpoint = strchr(optarg, ':') + 1;
+		}else if (c == 'x') {
+			opts.restore = optarg;
+		}else if (c == 'd') {
+			opts.deterministic = 1;
+		}else if (c == 'f' && strchr(optarg, ':') != NULL) {
+			opts.sample_detail = strtoul(optarg, NULL, 10);
+			opts.sample_period = strtoul(strchr(optarg, ':') + 1,
+						     NULL, 10);
+		}else{
+			optind = argc;
+			break;
+		}
+	}
+	/* A restored run has the workload of its snapshot, the configure
+	 * file may be left out. A stream cannot be read again */
+	int bad = (optind != argc - 1 &&
+		   (opts.restore == NULL || optind != argc)) ||
+		  opts.rate < 0 || opts.seed == 0 ||
+		  (opts.rate > 0 && opts.trace != NULL);
+	bad |= (naxes > 0 || objective >= 0) &&
+	       (opts.stream != NULL || opts.record != NULL ||
+		opts.checkpoint != NULL);
+	bad |= opts.checkpoint != NULL &&
+	       (opts.checkpoint_at == 0 || opts.stream != NULL);
+	bad |= opts.sample_period > 0 &&
+	       (opts.sample_detail == 0 ||
+		opts.sample_detail >= opts.sample_period);
+	bad |= opts.restore != NULL &&
+	       (opts.stream != NULL || opts.record != NULL ||
+		opts.trace != NULL || opts.rate > 0);
+	if (bad) {
+		printf("Usage: os [-s stream] [-r rate [-n count] [-S seed] |"
+		       " -T trace] [-R log] [-p mlq|prio]\n"
+		       "          [-w setting=value,...] [-a mean|p99|throughput]"
+		       " [-j jobs]\n"
+		       "          [-c slot:file] [-x file] [-f detail:period] [-d]"
+		       " [path to configure file]\n");
+		return 1;
+	}
+	opts.config = optind < argc ? argv[optind] : NULL;
+	if (objective >= 0)
+		return os_tune(&opts, axes, naxes, jobs, objective) == 0 ? 0 : 1;
+	if (naxes > 0)
+		return os_sweep(&opts, axes, naxes, jobs) == 0 ? 0 : 1;
+	return os_run(&opts, NULL) == 0 ? 0 : 1;
 
-
+}
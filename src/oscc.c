@@ -0,0 +1,54 @@
+/*
+ * oscc - compile text programs into the binary format of code.h
+ *
+ *   oscc <program> [output]
+ *
+ * Without [output] the compiled program is written next to the source,
+ * as <program>.bin. The loader recognises compiled programs by their
+ * magic, so a config line can name either form. It copies a compiled
+ * program when loading it rather than mapping it, so rewriting the
+ * file later does not change the processes already running it.
+ */
+
+#include "code.h"
+#include "loader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char * argv[]) {
+	if (argc < 2 || argc > 3) {
+		printf("Usage: oscc <program> [output]\n");
+		return 1;
+	}
+
+	uint32_t priority;
+	struct code_seg_t * code = load_code(argv[1], &priority);
+	if (code == NULL) {
+		printf("Rejected '%s': invalid program\n", argv[1]);
+		return 1;
+	}
+	if (code->compiled) {
+		printf("'%s' is already compiled\n", argv[1]);
+		return 1;
+	}
+
+	char out[256];
+	if (argc == 3)
+		snprintf(out, sizeof(out), "%s", argv[2]);
+	else
+		snprintf(out, sizeof(out), "%s.bin", argv[1]);
+
+	FILE * file;
+	if ((file = fopen(out, "wb")) == NULL) {
+		printf("Cannot create '%s'\n", out);
+		return 1;
+	}
+	if (code_write(file, code, priority) != 0 || fclose(file) != 0) {
+		printf("Cannot write '%s'\n", out);
+		remove(out);
+		return 1;
+	}
+	printf("%s: %u instructions, %u bytes\n", out, code->count, code->size);
+	return 0;
+}
@@ -14,13 +14,14 @@ Các thư viện và Header liên quan
 
 2. #include <stdlib.h>: Thư viện chuẩn C. Cần thiết vì nó định nghĩa NULL, được sử dụng rộng rãi trong các hàm để kiểm tra con trỏ.
 
-3. #include "queue.h": File header của chính nó. File này định nghĩa struct queue_t và MAX_QUEUE_SIZE, cũng như khai báo (prototype) cho các hàm mà queue.c sẽ hiện thực.
+3. #include "queue.h": File header của chính nó. File này định nghĩa struct queue_t, cũng như khai báo (prototype) cho các hàm mà queue.c sẽ hiện thực.
 
 4. Cấu trúc struct queue_t (từ queue.h) là trung tâm của file này:
 
 struct queue_t {
-    struct pcb_t * proc[MAX_QUEUE_SIZE]; // Một mảng các con trỏ trỏ đến PCB
-    int size;                         // Số lượng phần tử hiện có trong hàng đợi
+    struct pcb_t ** proc; // Một mảng các con trỏ trỏ đến PCB, lớn dần khi cần
+    int size;             // Số lượng phần tử hiện có trong hàng đợi
+    int cap;              // Số phần tử mảng proc chứa được
 };
 */
 
@@ -79,9 +80,9 @@ Chi tiết Code:
 
         1. Kiểm tra an toàn:
 
-                if (q == NULL || proc == NULL || q->size >= MAX_QUEUE_SIZE): Kiểm tra xem q và proc có hợp lệ không, và quan trọng nhất là hàng đợi đã bị đầy chưa (q->size >= MAX_QUEUE_SIZE).
+                if (q == NULL || proc == NULL): Kiểm tra xem q và proc có hợp lệ không. Nếu không, hàm sẽ return và không làm gì cả.
 
-                Nếu một trong các điều kiện này xảy ra, hàm sẽ return và không làm gì cả.
+                Nếu mảng proc đã đầy (q->size == q->cap), nó được cấp phát lại gấp đôi: không tiến trình nào bị bỏ rơi.
 
         2. Thêm vào cuối:
 
@@ -94,16 +95,35 @@ Chi tiết Code:
 void enqueue(struct queue_t *q, struct pcb_t *proc)
 {
         /* TODO: put a new process to queue [q] */
-        if (q == NULL || proc == NULL || q->size >= MAX_QUEUE_SIZE){
+        if (q == NULL || proc == NULL){
                 return;
         }
 
-        q->proc[q->size] = proc; // struct queue_t se có proc là struct pcb_t * proc[MAX_QUEUE_SIZE];
+        if (q->size == q->cap){
+                int cap = q->cap > 0 ? 2 * q->cap : 16;
+                struct pcb_t **p = realloc(q->proc, cap * sizeof(*p));
+                if (p == NULL){
+                        printf("Cannot grow a queue to %d processes\n", cap);
+                        exit(1);
+                }
+                q->proc = p;
+                q->cap = cap;
+        }
+
+        q->proc[q->size] = proc; // struct queue_t se có proc là struct pcb_t ** proc;
         q->size++;
 
 
 }
 
+void queue_free(struct queue_t *q)
+{
+        free(q->proc);
+        q->proc = NULL;
+        q->size = 0;
+        q->cap = 0;
+}
+
 
 
 /*
@@ -0,0 +1,212 @@
+/*
+ * replay - re-run the scheduling decisions of a recorded run
+ *
+ *   replay [-c cpus] [-t slice] [-p mlq|prio] [-b budget] <log>
+ *
+ * The log is written by "os -R <log>". Processes arrive as recorded and
+ * each one holds a CPU for the slots it ran, with no program and no
+ * memory behind it. The decisions are those of the scheduler built in
+ * sched.c, so a policy (-p, -b) or a setting of -c and -t can be tried on a
+ * recorded workload in a fraction of the time of a full simulation.
+ *
+ * A CPU behaves as cpu_routine() does, one slot at a time, but slots in
+ * which no CPU has a decision to take are skipped at once. Arrivals of
+ * a slot are admitted before the CPUs act, and the CPUs act in id order.
+ * The CPU hotplug timeline is not replayed.
+ */
+
+#include "cpu.h"
+#include "evlog.h"
+#include "sched.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* A process, the PCB first so the scheduler can hand it back */
+struct rproc {
+	struct pcb_t pcb;
+	uint64_t left;	/* Slots still to run */
+};
+
+struct rcpu {
+	struct rproc * proc;
+	uint64_t time_left;
+	int stopped;
+};
+
+static struct krnl_t krnl;
+static struct stats_t stats;
+static uint64_t decisions = 0;
+
+/* get_proc(), unless it already found nothing and no process was put
+ * back since. [dry] is cleared with each put_proc() */
+static struct rproc * get(int * dry) {
+	struct pcb_t * proc = NULL;
+
+	if (!*dry && (proc = get_proc(&krnl)) == NULL)
+		*dry = 1;
+	return (struct rproc *)proc;
+}
+
+int main(int argc, char * argv[]) {
+	struct rcpu cpus[MAX_CPU] = {{0}};
+	struct evlog_hdr hdr;
+	struct evlog_proc * procs;
+	size_t count, next = 0;
+	int num_cpus = 0, time_slot = 0;
+	int policy = SCHED_MLQ;
+	int budget = 0;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "c:t:p:b:")) != -1) {
+		if (c == 'c') {
+			num_cpus = atoi(optarg);
+		}else if (c == 't') {
+			time_slot = atoi(optarg);
+		}else if (c == 'p' && sched_policy(optarg) >= 0) {
+			policy = sched_policy(optarg);
+		}else if (c == 'b') {
+			budget = atoi(optarg);
+		}else{
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc - 1 || num_cpus < 0 || num_cpus > MAX_CPU ||
+	    time_slot < 0) {
+		printf("Usage: replay [-c cpus] [-t slice] [-p mlq|prio]"
+		       " [-b budget] <log>\n");
+		return 1;
+	}
+	if ((procs = evlog_read(argv[optind], &hdr, &count)) == NULL)
+		return 1;
+	if (num_cpus == 0)
+		num_cpus = hdr.cpus;
+	if (time_slot == 0)
+		time_slot = hdr.time_slot;
+	if (num_cpus < 1 || num_cpus > MAX_CPU || time_slot < 1) {
+		printf("Cannot replay on %d CPUs with a slice of %d\n",
+		       num_cpus, time_slot);
+		return 1;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	init_scheduler(&krnl, policy, budget);
+	stats_init(&stats);
+	krnl.stats = &stats;
+
+	/* The loader is done once the slot after the last arrival begins */
+	uint64_t done_at = count ? procs[count - 1].arrival + 1 : 0;
+	uint64_t t = 0;
+	int running = num_cpus;
+	while (running > 0) {
+		int changed = 0;	/* The ready queues changed in this slot */
+		int dry = 0;
+
+		while (next < count && procs[next].arrival <= t) {
+			struct rproc * p = calloc(1, sizeof(struct rproc));
+			p->pcb.pid = next + 1;
+			p->pcb.priority = procs[next].priority;
+			p->pcb.krnl = &krnl;
+			p->left = procs[next].demand;
+			stats_arrival(&stats, &p->pcb, t);
+			add_proc(&p->pcb);
+			decisions++;
+			changed = 1;
+			next++;
+		}
+		int done = (next == count && t >= done_at);
+
+		for (i = 0; i < num_cpus; i++) {
+			struct rcpu * cpu = &cpus[i];
+
+			if (cpu->stopped)
+				continue;
+			if (cpu->proc == NULL) {
+				cpu->proc = get(&dry);
+				if (cpu->proc == NULL && !done)
+					continue;
+			}else if (cpu->proc->left == 0) {
+				stats_finish(&stats, &cpu->proc->pcb, t);
+				finish_proc(&cpu->proc->pcb);
+				free(cpu->proc);
+				cpu->proc = get(&dry);
+				cpu->time_left = 0;
+				decisions++;
+			}else if (cpu->time_left == 0) {
+				put_proc(&cpu->proc->pcb);
+				dry = 0;
+				cpu->proc = get(&dry);
+				decisions++;
+				changed = 1;
+			}
+
+			if (cpu->proc == NULL && done) {
+				cpu->stopped = 1;
+				running--;
+				continue;
+			}else if (cpu->proc == NULL) {
+				continue;
+			}else if (cpu->time_left == 0) {
+				cpu->time_left = time_slot;
+				decisions++;
+			}
+			if (cpu->proc->left > 0)
+				cpu->proc->left--;
+			cpu->time_left--;
+		}
+
+		/* Next slot in which something happens: an arrival, the end
+		 * of the loader, a CPU done with its process or its slice,
+		 * or an idle CPU that may find a process queued meanwhile */
+		uint64_t when = UINT64_MAX;
+		if (next < count)
+			when = procs[next].arrival;
+		else if (t < done_at)
+			when = done_at;
+		for (i = 0; i < num_cpus; i++) {
+			struct rcpu * cpu = &cpus[i];
+			uint64_t at;
+
+			if (cpu->stopped)
+				continue;
+			if (cpu->proc == NULL) {
+				at = changed ? t + 1 : UINT64_MAX;
+			}else{
+				at = cpu->proc->left < cpu->time_left ?
+					cpu->proc->left : cpu->time_left;
+				at += t + 1;
+			}
+			if (at < when)
+				when = at;
+		}
+		if (when == UINT64_MAX || when <= t)
+			when = t + 1;
+
+		/* The CPUs keep running until then */
+		uint64_t d = when - t - 1;
+		for (i = 0; i < num_cpus; i++) {
+			if (cpus[i].stopped || cpus[i].proc == NULL)
+				continue;
+			cpus[i].proc->left -= d < cpus[i].proc->left ?
+					      d : cpus[i].proc->left;
+			cpus[i].time_left -= d;
+		}
+		t = when;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double secs = (end.tv_sec - start.tv_sec) +
+		      (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+	printf("Replayed %lu processes on %d CPUs, slice %d, %s: %lu decisions"
+	       " in %.3f s (%.0f/s)\n", (unsigned long)count, num_cpus,
+	       time_slot, sched_policy_name(policy), (unsigned long)decisions,
+	       secs, secs > 0 ? decisions / secs : 0.0);
+	stats_report(&stats, stdout, 0);
+	finish_scheduler(&krnl);
+	free(procs);
+	return 0;
+}
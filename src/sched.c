@@ -69,28 +69,45 @@ Cấu trúc dữ liệu chính (Biến static)
  */
 #include "queue.h"
 #include "sched.h"
+#include "ckpt.h"
 #include <pthread.h>
 
 #include <stdlib.h>
 #include <stdio.h>
-static struct queue_t ready_queue;
-static struct queue_t run_queue;
-static pthread_mutex_t queue_lock;
+#include <string.h>
 
-static struct queue_t running_list;
+/* Ready queues of one kernel, krnl->sched */
+struct sched_t {
+	enum sched_policy policy;
+	int budget;		/* Slots of level 0, see level_slots() */
+	struct queue_t ready_queue;
+	struct queue_t run_queue;
+	pthread_mutex_t queue_lock;
+
+	struct queue_t running_list;
 #ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
-static int slot[MAX_PRIO];
+	struct queue_t mlq_ready_queue[MAX_PRIO];
+	int slot[MAX_PRIO];
 #endif
+};
+
+/* Slots a level is served for before it is demoted from. Levels get
+ * fewer slots the lower they are, MAX_PRIO - prio for the default
+ * budget of MAX_PRIO, and always at least one */
+static int level_slots(const struct sched_t * s, int prio) {
+	int n = s->budget * (MAX_PRIO - prio) / MAX_PRIO;
+	return n > 0 ? n : 1;
+}
 
-int queue_empty(void) {
+int queue_empty(struct krnl_t * krnl) {
+	struct sched_t * s = krnl->sched;
 #ifdef MLQ_SCHED
 	unsigned long prio;
 	for (prio = 0; prio < MAX_PRIO; prio++)
-		if(!empty(&mlq_ready_queue[prio])) 
+		if(!empty(&s->mlq_ready_queue[prio])) 
 			return -1;
 #endif
-	return (empty(&ready_queue) && empty(&run_queue));
+	return (empty(&s->ready_queue) && empty(&s->run_queue));
 }
 
 
@@ -116,19 +133,162 @@ Chi tiết Code:
 
 	4. Khởi tạo running_list và queue_lock.
 */
-void init_scheduler(void) {
+void init_scheduler(struct krnl_t * krnl, enum sched_policy policy,
+		int budget) {
+	struct sched_t * s = (struct sched_t *)calloc(1, sizeof(struct sched_t));
+	s->policy = policy;
+	s->budget = budget > 0 ? budget : MAX_PRIO;
 #ifdef MLQ_SCHED
     int i ;
 
 	for (i = 0; i < MAX_PRIO; i ++) {
-		mlq_ready_queue[i].size = 0;
-		slot[i] = MAX_PRIO - i; 
+		s->mlq_ready_queue[i].size = 0;
+		s->slot[i] = level_slots(s, i); 
+	}
+#endif
+	s->ready_queue.size = 0;
+	s->run_queue.size = 0;
+	s->running_list.size = 0;
+	pthread_mutex_init(&s->queue_lock, NULL);
+
+	krnl->sched = s;
+	krnl->ready_queue = &s->ready_queue;
+	krnl->running_list = &s->running_list;
+#ifdef MLQ_SCHED
+	krnl->mlq_ready_queue = s->mlq_ready_queue;
+#endif
+}
+
+/* The queues of [s] in a fixed order, the running list last */
+static int sched_queues(struct sched_t * s, struct queue_t ** q) {
+	int n = 0;
+#ifdef MLQ_SCHED
+	int prio;
+	for (prio = 0; prio < MAX_PRIO; prio++)
+		q[n++] = &s->mlq_ready_queue[prio];
+#endif
+	q[n++] = &s->ready_queue;
+	q[n++] = &s->run_queue;
+	q[n++] = &s->running_list;
+	return n;
+}
+
+#define SCHED_QUEUES (MAX_PRIO + 3)
+
+void finish_scheduler(struct krnl_t * krnl) {
+	struct queue_t * q[SCHED_QUEUES];
+	int n = sched_queues(krnl->sched, q);
+	int i;
+
+	for (i = 0; i < n; i++)
+		queue_free(q[i]);
+	pthread_mutex_destroy(&krnl->sched->queue_lock);
+	free(krnl->sched);
+	krnl->sched = NULL;
+}
+
+void sched_list(struct krnl_t * krnl, struct ckpt * ck) {
+	struct queue_t * q[SCHED_QUEUES];
+	int n = sched_queues(krnl->sched, q) - 1;
+	int i, j;
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < q[i]->size; j++)
+			ckpt_add_proc(ck, q[i]->proc[j]);
+}
+
+void sched_save(struct krnl_t * krnl, struct ckpt * ck) {
+	struct sched_t * s = krnl->sched;
+	struct queue_t * q[SCHED_QUEUES];
+	int n = sched_queues(s, q);
+	int i, j;
+
+	pthread_mutex_lock(&s->queue_lock);
+#ifdef MLQ_SCHED
+	CKPT_PUT(ck, s->slot);
+#endif
+	for (i = 0; i < n; i++) {
+		/* Only the processes [ck] knows of, as in sched_list() */
+		int32_t size = 0;
+		for (j = 0; j < q[i]->size; j++)
+			size += ckpt_proc_index(ck, q[i]->proc[j]) >= 0;
+		CKPT_PUT(ck, size);
+		for (j = 0; j < q[i]->size; j++)
+			if (ckpt_proc_index(ck, q[i]->proc[j]) >= 0)
+				ckpt_put_proc(ck, q[i]->proc[j]);
 	}
+	pthread_mutex_unlock(&s->queue_lock);
+}
+
+int sched_restore(struct krnl_t * krnl, struct ckpt * ck) {
+	struct sched_t * s = krnl->sched;
+	struct queue_t * q[SCHED_QUEUES];
+	int n = sched_queues(s, q);
+	int i, j;
+
+#ifdef MLQ_SCHED
+	CKPT_GET(ck, s->slot);
 #endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
-	running_list.size = 0;
-	pthread_mutex_init(&queue_lock, NULL);
+	for (i = 0; i < n; i++) {
+		int32_t size = -1;
+		if (CKPT_GET(ck, size) != 0 || size < 0 || size > CKPT_LIST_MAX)
+			return -1;
+		for (j = 0; j < size; j++) {
+			struct pcb_t * proc = ckpt_get_proc(ck);
+			if (proc == NULL)
+				return -1;
+			enqueue(q[i], proc);
+		}
+	}
+	return 0;
+}
+
+int sched_policy(const char * name) {
+	if (!strcmp(name, "mlq"))
+		return SCHED_MLQ;
+	if (!strcmp(name, "prio"))
+		return SCHED_PRIO;
+	return -1;
+}
+
+const char * sched_policy_name(enum sched_policy policy) {
+	return policy == SCHED_MLQ ? "mlq" : "prio";
+}
+
+/* One ready queue, served in the order dequeue() picks: priority first,
+ * then arrival. A process whose slice is over waits in run_queue until
+ * ready_queue is empty, so every ready process runs once per round */
+static struct pcb_t * get_prio_proc(struct sched_t * s) {
+	struct pcb_t * proc = NULL;
+
+	pthread_mutex_lock(&s->queue_lock);
+	if (empty(&s->ready_queue)) {
+		struct queue_t q = s->ready_queue;
+		s->ready_queue = s->run_queue;
+		s->run_queue = q;
+	}
+	if (!empty(&s->ready_queue)) {
+		proc = dequeue(&s->ready_queue);
+		if (proc) enqueue(&s->running_list, proc);
+	}
+	pthread_mutex_unlock(&s->queue_lock);
+	return proc;
+}
+
+static void put_prio_proc(struct sched_t * s, struct pcb_t * proc) {
+	pthread_mutex_lock(&s->queue_lock);
+	purgequeue(&s->running_list, proc);
+	enqueue(&s->run_queue, proc);
+	pthread_mutex_unlock(&s->queue_lock);
+}
+
+static void add_prio_proc(struct sched_t * s, struct pcb_t * proc) {
+#ifdef MLQ_SCHED
+	proc->prio = proc->priority;
+#endif
+	pthread_mutex_lock(&s->queue_lock);
+	enqueue(&s->ready_queue, proc);
+	pthread_mutex_unlock(&s->queue_lock);
 }
 
 #ifdef MLQ_SCHED
@@ -173,32 +333,53 @@ Chi tiết Code:
 
 	7. return proc;: Trả proc về cho CPU (hoặc trả NULL nếu không có tiến trình nào sẵn sàng).
 */
-struct pcb_t * get_mlq_proc(void) { // ham nay dung de lay tu hang doi (queue.h) uu tien cao nhat co tien trinh
-	struct pcb_t * proc = NULL;
-
-	pthread_mutex_lock(&queue_lock);
-	/*TODO: get a process from PRIORITY [ready_queue].
-	 *      It worth to protect by a mechanism.
-	 * */
-
+/* The first process of the highest level that has slots left, NULL if
+ * there is none. queue_lock held */
+static struct pcb_t * mlq_pick(struct sched_t * s) {
 	for (int prio = 0; prio < MAX_PRIO; prio++){
-		if (slot[prio] > 0 && !empty(&mlq_ready_queue[prio])){
-			proc = dequeue(&mlq_ready_queue[prio]);
+		if (s->slot[prio] > 0 && !empty(&s->mlq_ready_queue[prio])){
+			struct pcb_t * proc = dequeue(&s->mlq_ready_queue[prio]);
 			if (proc != NULL){
-				slot[prio]--; //dung mot slot
-				break;
+				s->slot[prio]--; //dung mot slot
+				return proc;
 			}
 		}
 	}
+	return NULL;
+}
+
+static int mlq_empty(struct sched_t * s) {
+	for (int prio = 0; prio < MAX_PRIO; prio++)
+		if (!empty(&s->mlq_ready_queue[prio]))
+			return 0;
+	return 1;
+}
 
+static struct pcb_t * get_mlq_proc(struct sched_t * s) { // ham nay dung de lay tu hang doi (queue.h) uu tien cao nhat co tien trinh
+	struct pcb_t * proc = NULL;
 
+	pthread_mutex_lock(&s->queue_lock);
+	/*TODO: get a process from PRIORITY [ready_queue].
+	 *      It worth to protect by a mechanism.
+	 * */
+
+	proc = mlq_pick(s);
+	if (proc == NULL && !mlq_empty(s)) {
+		/* Every level with a process waiting has used its slots,
+		 * and put_mlq_proc() only refills the level a process is
+		 * demoted to. A new round starts with all of them refilled,
+		 * or those processes would never run */
+		for (int prio = 0; prio < MAX_PRIO; prio++)
+			s->slot[prio] = level_slots(s, prio);
+		proc = mlq_pick(s);
+	}
 
 
 	//cua thay
 	if (proc != NULL)
-		enqueue(&running_list, proc);
+		enqueue(&s->running_list, proc);
 
-	pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_unlock(&s->queue_lock);
 	return proc;	
 }
 
@@ -228,28 +409,24 @@ Chi tiết Code:
 
 	7. pthread_mutex_unlock(&queue_lock);: Mở khóa.
 */
-void put_mlq_proc(struct pcb_t * proc) { // dua lai vao hang doi dung prio, giam slot[prio]
-	proc->krnl->ready_queue = &ready_queue;
-	proc->krnl->mlq_ready_queue = mlq_ready_queue;
-	proc->krnl->running_list = &running_list;
-
+static void put_mlq_proc(struct sched_t * s, struct pcb_t * proc) { // dua lai vao hang doi dung prio, giam slot[prio]
 	/* TODO: put running proc to running_list 
 	 *       It worth to protect by a mechanism.
 	 * 
 	 */
-	pthread_mutex_lock(&queue_lock);
-
+	pthread_mutex_lock(&s->queue_lock);
+	purgequeue(&s->running_list, proc);
 
 	int prio = proc->prio;
 	if (prio < 0) prio = 0;
 	if (prio >= MAX_PRIO) prio = MAX_PRIO - 1;
 	// neu het slot, chuyen xuong hang doi thap hon (co do uu tien tap hon)
-	if (slot[prio] <= 0){
+	if (s->slot[prio] <= 0){
 		prio++;
 		if (prio >= MAX_PRIO){
 			prio = MAX_PRIO - 1;
 		}
-		slot[prio] = MAX_PRIO - prio; // o tren co de cap (dong 57)
+		s->slot[prio] = level_slots(s, prio); // o tren co de cap (dong 57)
 	}
 	
 	proc->prio = prio;
@@ -257,8 +434,8 @@ void put_mlq_proc(struct pcb_t * proc) { // dua lai vao hang doi dung prio, giam
 
 	//cua thay
 	
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+	enqueue(&s->mlq_ready_queue[proc->prio], proc);
+	pthread_mutex_unlock(&s->queue_lock);
 }
 
 
@@ -280,17 +457,13 @@ Chi tiết Code:
 
 	6. pthread_mutex_unlock(&queue_lock);: Mở khóa.
 */
-void add_mlq_proc(struct pcb_t * proc) {//them moi vao hang doi dung prio
-	proc->krnl->ready_queue = &ready_queue;
-	proc->krnl->mlq_ready_queue = mlq_ready_queue;
-	proc->krnl->running_list = &running_list;
-
+static void add_mlq_proc(struct sched_t * s, struct pcb_t * proc) {//them moi vao hang doi dung prio
 	/* TODO: put running proc to running_list
 	 *       It worth to protect by a mechanism.
 	 * 
 	 */
        
-	pthread_mutex_lock(&queue_lock);
+	pthread_mutex_lock(&s->queue_lock);
 
 	int prio = proc->priority; // proc->prio la cai ma sau khi qua xu ly dc gan lai, con priority se la cai ma minh tu gan ban dau
 	if (prio < 0) prio = 0;
@@ -299,8 +472,8 @@ void add_mlq_proc(struct pcb_t * proc) {//them moi vao hang doi dung prio
 	proc->prio = prio;
 
 
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);	
+	enqueue(&s->mlq_ready_queue[proc->prio], proc);
+	pthread_mutex_unlock(&s->queue_lock);	
 }
 
 
@@ -312,63 +485,41 @@ Chức năng: Đây là các hàm "wrapper" (hàm bọc) công khai.
 
 Chi tiết Code: Chúng chỉ đơn giản là gọi các hàm _mlq_ tương ứng. Việc này giúp che giấu logic MLQ bên trong và cho phép dễ dàng thay đổi thuật toán lập lịch (ví dụ, thay bằng FIFO) mà không cần sửa code ở cpu.c.
 */
-struct pcb_t * get_proc(void) {
-	return get_mlq_proc();
+struct pcb_t * get_proc(struct krnl_t * krnl) {
+	if (krnl->sched->policy == SCHED_PRIO)
+		return get_prio_proc(krnl->sched);
+	return get_mlq_proc(krnl->sched);
 }
 
 void put_proc(struct pcb_t * proc) {
-	return put_mlq_proc(proc);
+	if (proc->krnl->sched->policy == SCHED_PRIO)
+		return put_prio_proc(proc->krnl->sched, proc);
+	return put_mlq_proc(proc->krnl->sched, proc);
 }
 
 void add_proc(struct pcb_t * proc) {
-	return add_mlq_proc(proc);
+	if (proc->krnl->sched->policy == SCHED_PRIO)
+		return add_prio_proc(proc->krnl->sched, proc);
+	return add_mlq_proc(proc->krnl->sched, proc);
 }
 #else // này là phần của 32bit, muốn thì làm thêm
-struct pcb_t * get_proc(void) {
-	struct pcb_t * proc = NULL;
-
-	pthread_mutex_lock(&queue_lock);
-	/*TODO: get a process from [ready_queue].
-	 *       It worth to protect by a mechanism.
-	 * 
-	 */
-	if (!empty(&ready_queue)) {
-		proc = dequeue(&ready_queue);
-		if (proc) enqueue(&running_list, proc);
-	}
-
-	pthread_mutex_unlock(&queue_lock);
-
-	return proc;
+struct pcb_t * get_proc(struct krnl_t * krnl) {
+	return get_prio_proc(krnl->sched);
 }
 
 void put_proc(struct pcb_t * proc) {
-	proc->krnl->ready_queue = &ready_queue;
-	proc->krnl->running_list = &running_list;
-
-	/* TODO: put running proc to running_list 
-	 *       It worth to protect by a mechanism.
-	 * 
-	 */
-
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&run_queue, proc);
-	pthread_mutex_unlock(&queue_lock);
+	return put_prio_proc(proc->krnl->sched, proc);
 }
 
 void add_proc(struct pcb_t * proc) {
-	proc->krnl->ready_queue = &ready_queue;
-	proc->krnl->running_list = &running_list;
-
-	/* TODO: put running proc to running_list 
-	 *       It worth to protect by a mechanism.
-	 * 
-	 */
-
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&ready_queue, proc);
-	pthread_mutex_unlock(&queue_lock);	
+	return add_prio_proc(proc->krnl->sched, proc);
 }
 #endif
 
+void finish_proc(struct pcb_t * proc) {
+	struct sched_t * s = proc->krnl->sched;
 
+	pthread_mutex_lock(&s->queue_lock);
+	purgequeue(&s->running_list, proc);
+	pthread_mutex_unlock(&s->queue_lock);
+}
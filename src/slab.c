@@ -0,0 +1,137 @@
+
+#include "slab.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct kmem_cache {
+	const char * name;
+	size_t size;		// Object size, rounded up to SLAB_ALIGN
+	int id;			// Index of the thread magazines
+	pthread_mutex_t lock;
+	void * depot;		// Free objects, linked through their first word
+};
+
+struct magazine {
+	int n;
+	void * obj[SLAB_MAG_SZ];
+};
+
+/* Magazines of a thread, one per cache */
+struct kmem_local {
+	struct magazine mag[SLAB_MAX_CACHES];
+};
+
+static struct kmem_cache caches[SLAB_MAX_CACHES];
+static int nr_caches = 0;
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct kmem_local * local = NULL;
+static pthread_key_t local_key;
+static pthread_once_t local_once = PTHREAD_ONCE_INIT;
+
+/* Move [n] objects of a magazine back to the depot */
+static void drain(struct kmem_cache * cache, struct magazine * mag, int n) {
+	pthread_mutex_lock(&cache->lock);
+	while (n-- > 0) {
+		void * obj = mag->obj[--mag->n];
+		*(void **)obj = cache->depot;
+		cache->depot = obj;
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/* A thread going away hands its magazines back */
+static void local_release(void * arg) {
+	struct kmem_local * l = (struct kmem_local *)arg;
+	int i;
+
+	for (i = 0; i < nr_caches; i++)
+		drain(&caches[i], &l->mag[i], l->mag[i].n);
+	free(l);
+}
+
+static void local_key_create(void) {
+	pthread_key_create(&local_key, local_release);
+}
+
+static struct kmem_local * get_local(void) {
+	if (local == NULL) {
+		pthread_once(&local_once, local_key_create);
+		local = (struct kmem_local *)calloc(1, sizeof(struct kmem_local));
+		if (local == NULL) {
+			printf("Cannot allocate slab magazines\n");
+			exit(1);
+		}
+		pthread_setspecific(local_key, local);
+	}
+	return local;
+}
+
+/* Carve a new slab into the depot, called with the cache locked */
+static int grow(struct kmem_cache * cache) {
+	char * slab;
+	int i;
+
+	if (posix_memalign((void **)&slab, SLAB_ALIGN, cache->size * SLAB_OBJS))
+		return -1;
+	for (i = 0; i < SLAB_OBJS; i++) {
+		void * obj = slab + i * cache->size;
+		*(void **)obj = cache->depot;
+		cache->depot = obj;
+	}
+	return 0;
+}
+
+/* Fill half a magazine from the depot */
+static void refill(struct kmem_cache * cache, struct magazine * mag) {
+	pthread_mutex_lock(&cache->lock);
+	while (mag->n < SLAB_MAG_SZ / 2) {
+		if (cache->depot == NULL && grow(cache) != 0)
+			break;
+		void * obj = cache->depot;
+		cache->depot = *(void **)obj;
+		mag->obj[mag->n++] = obj;
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+struct kmem_cache * kmem_cache_create(const char * name, size_t size) {
+	struct kmem_cache * cache = NULL;
+
+	pthread_mutex_lock(&caches_lock);
+	if (nr_caches < SLAB_MAX_CACHES) {
+		cache = &caches[nr_caches];
+		cache->name = name;
+		if (size < sizeof(void *))
+			size = sizeof(void *);
+		cache->size = (size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+		cache->id = nr_caches;
+		pthread_mutex_init(&cache->lock, NULL);
+		cache->depot = NULL;
+		nr_caches++;
+	}
+	pthread_mutex_unlock(&caches_lock);
+	return cache;
+}
+
+void * kmem_cache_alloc(struct kmem_cache * cache) {
+	struct magazine * mag = &get_local()->mag[cache->id];
+
+	if (mag->n == 0)
+		refill(cache, mag);
+	if (mag->n == 0)
+		return NULL;
+	return mag->obj[--mag->n];
+}
+
+void kmem_cache_free(struct kmem_cache * cache, void * obj) {
+	struct magazine * mag = &get_local()->mag[cache->id];
+
+	if (obj == NULL)
+		return;
+	if (mag->n == SLAB_MAG_SZ)
+		drain(cache, mag, SLAB_MAG_SZ / 2);
+	mag->obj[mag->n++] = obj;
+}
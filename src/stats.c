@@ -0,0 +1,232 @@
+
+#include "stats.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Values below 2 * STATS_SUB have a bucket each. Above, a power of two
+ * is split in STATS_SUB buckets */
+static int bucket(uint64_t v) {
+	int shift;
+
+	if (v < 2 * STATS_SUB)
+		return (int)v;
+	shift = (63 - __builtin_clzll(v)) - __builtin_ctz(STATS_SUB);
+	return shift * STATS_SUB + (int)(v >> shift);
+}
+
+/* Lowest value of a bucket */
+static uint64_t bucket_value(int b) {
+	int shift;
+
+	if (b < 2 * STATS_SUB)
+		return b;
+	shift = b / STATS_SUB - 1;
+	return (uint64_t)(b % STATS_SUB + STATS_SUB) << shift;
+}
+
+void stats_init(struct stats_t * stats) {
+	memset(stats, 0, sizeof(*stats));
+	stats->first_arrival = UINT64_MAX;
+	pthread_mutex_init(&stats->lock, NULL);
+}
+
+void stats_destroy(struct stats_t * stats) {
+	free(stats->windows);
+	pthread_mutex_destroy(&stats->lock);
+}
+
+void stats_sample(struct stats_t * stats, uint64_t detail,
+		uint64_t period, uint64_t from) {
+	stats->detail = detail;
+	stats->period = period;
+	stats->from = from;
+}
+
+uint64_t stats_gap(const struct stats_t * stats, uint64_t time) {
+	uint64_t phase;
+
+	if (stats->period == 0 || time < stats->from)
+		return 0;
+	phase = (time - stats->from) % stats->period;
+	return phase < stats->detail ? 0 : stats->period - phase;
+}
+
+/* Count a process finished in window [w], lock held. Windows are
+ * grown by doubling, a window that cannot be kept is left out */
+static void window_add(struct stats_t * stats, size_t w,
+		uint64_t turnaround) {
+	if (w >= stats->nwindows) {
+		struct stats_window * windows;
+		size_t n = stats->nwindows > 0 ? stats->nwindows : 16;
+
+		while (n <= w)
+			n *= 2;
+		windows = realloc(stats->windows, n * sizeof(*windows));
+		if (windows == NULL)
+			return;
+		memset(windows + stats->nwindows, 0,
+		       (n - stats->nwindows) * sizeof(*windows));
+		stats->windows = windows;
+		stats->nwindows = n;
+	}
+	stats->windows[w].finished++;
+	stats->windows[w].total += turnaround;
+}
+
+void stats_arrival(struct stats_t * stats, struct pcb_t * proc,
+		uint64_t time) {
+	proc->arrival = time;
+	pthread_mutex_lock(&stats->lock);
+	stats->admitted++;
+	if (time < stats->first_arrival)
+		stats->first_arrival = time;
+	if (time > stats->last_arrival)
+		stats->last_arrival = time;
+	pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_finish(struct stats_t * stats, const struct pcb_t * proc,
+		uint64_t time) {
+	uint64_t turnaround = time - proc->arrival;
+
+	pthread_mutex_lock(&stats->lock);
+	stats->hist[bucket(turnaround)]++;
+	stats->finished++;
+	stats->total += turnaround;
+	if (time > stats->last_finish)
+		stats->last_finish = time;
+	if (stats->period > 0 && time >= stats->from &&
+	    stats_gap(stats, time) == 0)
+		window_add(stats, (time - stats->from) / stats->period,
+			   turnaround);
+	pthread_mutex_unlock(&stats->lock);
+}
+
+/* Smallest turnaround at or above the [q] quantile */
+static uint64_t percentile(const struct stats_t * stats, double q) {
+	uint64_t rank = (uint64_t)(q * stats->finished);
+	uint64_t seen = 0;
+	int b;
+
+	if (rank >= stats->finished)
+		rank = stats->finished - 1;
+	for (b = 0; b < STATS_BUCKETS; b++) {
+		seen += stats->hist[b];
+		if (seen > rank)
+			return bucket_value(b);
+	}
+	return 0;
+}
+
+void stats_summary(struct stats_t * stats, double offered,
+		struct stats_summary * sum) {
+	memset(sum, 0, sizeof(*sum));
+	pthread_mutex_lock(&stats->lock);
+	if (offered <= 0 && stats->admitted > 0)
+		offered = (double)stats->admitted /
+			(stats->last_arrival - stats->first_arrival + 1);
+	sum->offered = offered;
+	sum->admitted = stats->admitted;
+	sum->finished = stats->finished;
+	if (stats->finished > 0) {
+		sum->span = stats->last_finish - stats->first_arrival;
+		sum->throughput = sum->span ?
+			(double)stats->finished / sum->span : 0.0;
+		sum->mean = (double)stats->total / stats->finished;
+		sum->p50 = percentile(stats, 0.50);
+		sum->p99 = percentile(stats, 0.99);
+		sum->p999 = percentile(stats, 0.999);
+	}
+	pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_report(struct stats_t * stats, FILE * out, double offered) {
+	struct stats_summary sum;
+
+	stats_summary(stats, offered, &sum);
+	fprintf(out, "Offered load %.3f processes/slot\n", sum.offered);
+	fprintf(out, "\tAdmitted %lu, finished %lu", (unsigned long)sum.admitted,
+		(unsigned long)sum.finished);
+	if (sum.finished == 0) {
+		fprintf(out, "\n");
+		return;
+	}
+	fprintf(out, " in %lu slots\n", (unsigned long)sum.span);
+	fprintf(out, "\tThroughput %.3f processes/slot\n", sum.throughput);
+	fprintf(out, "\tTurnaround mean %.1f p50 %lu p99 %lu p999 %lu slots%s\n",
+		sum.mean, (unsigned long)sum.p50, (unsigned long)sum.p99,
+		(unsigned long)sum.p999,
+		sum.finished < sum.admitted ? ", finished ones only" : "");
+}
+
+/* Two-sided 95% quantile of Student's t with [df] degrees of freedom */
+static double t95(uint64_t df) {
+	static const double t[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+		2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+		2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+		2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+	};
+
+	if (df == 0)
+		return INFINITY;
+	return df <= 30 ? t[df - 1] : 1.960;
+}
+
+/* The windows are a systematic sample of the run: throughput is the
+ * mean over windows, the turnaround a ratio of the totals over the
+ * processes, each with the variance of its estimator across windows */
+void stats_sampled(struct stats_t * stats, FILE * out, uint64_t detailed,
+		uint64_t forwarded) {
+	uint64_t begin, first, last, n, k, f = 0, t = 0;
+	double x, mean, ratio, sx = 0, sr = 0, ci_x, ci_r;
+
+	pthread_mutex_lock(&stats->lock);
+	fprintf(out, "Sampled windows of %lu slots every %lu slots\n",
+		(unsigned long)stats->detail, (unsigned long)stats->period);
+	fprintf(out, "\tInstructions %lu detailed, %lu fast-forwarded\n",
+		(unsigned long)detailed, (unsigned long)forwarded);
+	if (stats->finished == 0 || stats->last_finish < stats->from) {
+		fprintf(out, "\tNo process finished\n");
+		pthread_mutex_unlock(&stats->lock);
+		return;
+	}
+	/* Windows from the first arrival to the last finish */
+	begin = stats->first_arrival > stats->from ?
+		stats->first_arrival : stats->from;
+	first = (begin - stats->from) / stats->period;
+	last = (stats->last_finish - stats->from) / stats->period;
+	n = last - first + 1;
+	for (k = first; k <= last && k < stats->nwindows; k++) {
+		f += stats->windows[k].finished;
+		t += stats->windows[k].total;
+	}
+	mean = (double)f / stats->detail / n;
+	ratio = f > 0 ? (double)t / f : 0.0;
+	for (k = first; k <= last; k++) {
+		struct stats_window w = {0, 0};
+
+		if (k < stats->nwindows)
+			w = stats->windows[k];
+		x = (double)w.finished / stats->detail - mean;
+		sx += x * x;
+		x = (double)w.total - ratio * w.finished;
+		sr += x * x;
+	}
+	ci_x = n > 1 ? t95(n - 1) * sqrt(sx / (n - 1) / n) : INFINITY;
+	ci_r = n > 1 && f > 0 ? t95(n - 1) * sqrt(sr / (n - 1) / n) /
+		((double)f / n) : INFINITY;
+	fprintf(out, "\t%lu windows, %lu processes finished in them\n",
+		(unsigned long)n, (unsigned long)f);
+	fprintf(out, "\tThroughput %.3f +- %.3f processes/slot,"
+		" %.0f +- %.0f finished in %lu slots\n", mean, ci_x,
+		mean * (stats->last_finish - begin),
+		ci_x * (stats->last_finish - begin),
+		(unsigned long)(stats->last_finish - begin));
+	if (f > 0)
+		fprintf(out, "\tTurnaround mean %.1f +- %.1f slots\n",
+			ratio, ci_r);
+	pthread_mutex_unlock(&stats->lock);
+}
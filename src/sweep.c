@@ -0,0 +1,433 @@
+
+#include "os.h"
+#include "cpu.h"
+#include "loader.h"
+#include "sched.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Parameter sweeps and tuning in one host process. Each configuration
+ * tried is a run of its own kernel (see os_run()), up to [jobs] of them
+ * at once. The code cache is held meanwhile, so that a program is read
+ * and verified once however many runs load it */
+
+#define SWEEP_VALUES	32	/* Values of a setting */
+
+/* Successive halving: TUNE_CANDIDATES configurations at most are tried
+ * on a part of the workload, the best one in TUNE_ETA is tried again on
+ * TUNE_ETA times as many arrivals, and so on up to the whole workload.
+ * The first round gets TUNE_MIN_ARRIVALS arrivals at least */
+#define TUNE_CANDIDATES		81
+#define TUNE_ETA		3
+#define TUNE_MIN_ARRIVALS	8
+
+enum { AX_SLOT, AX_CPUS, AX_RAM, AX_SWAP, AX_BUDGET, AX_POLICY, NUM_AXES };
+
+static const char * axis_names[NUM_AXES] = {
+	"slot", "cpus", "ram", "swap", "budget", "policy"
+};
+
+static const char * objective_names[] = {
+	"mean", "p99", "throughput"
+};
+
+struct axis {
+	int setting;		/* AX_xxx */
+	int count;
+	int values[SWEEP_VALUES];
+};
+
+struct sweep_run {
+	struct os_opts opts;
+	struct stats_summary sum;
+	double score;		/* Objective of a tuning run, lower is better */
+	double secs;
+	int ret;
+};
+
+struct run_pool {
+	struct sweep_run ** runs;
+	int count;
+	int next;		/* Next run to start */
+	pthread_mutex_t lock;
+};
+
+/* Parse "name=value,value,..." into [ax]. Return 0 on success */
+static int parse_axis(char * spec, struct axis * ax) {
+	char * eq = strchr(spec, '=');
+	char * v;
+
+	if (eq == NULL)
+		return -1;
+	*eq = '\0';
+	for (ax->setting = 0; ax->setting < NUM_AXES; ax->setting++) {
+		if (!strcmp(spec, axis_names[ax->setting]))
+			break;
+	}
+	*eq = '=';
+	if (ax->setting == NUM_AXES)
+		return -1;
+
+	ax->count = 0;
+	for (v = strtok(eq + 1, ","); v != NULL; v = strtok(NULL, ",")) {
+		int n;
+
+		if (ax->count == SWEEP_VALUES)
+			return -1;
+		if (ax->setting == AX_POLICY) {
+			n = sched_policy(v);
+		}else{
+			char * end;
+			n = (int)strtol(v, &end, 0);
+			if (*end != '\0' || n < 1)
+				n = -1;
+		}
+		if (n < 0 || (ax->setting == AX_CPUS && n > MAX_CPU))
+			return -1;
+		ax->values[ax->count++] = n;
+	}
+	return ax->count > 0 ? 0 : -1;
+}
+
+/* Parse the [naxes] settings of [axes] into [ax]. Return the number of
+ * configurations they span, -1 on error */
+static long parse_axes(char ** axes, int naxes, struct axis * ax) {
+	long count = 1;
+	int a;
+
+	if (naxes > NUM_AXES)
+		return -1;
+	for (a = 0; a < naxes; a++) {
+		if (parse_axis(axes[a], &ax[a]) != 0) {
+			printf("Bad sweep setting %s\n", axes[a]);
+			return -1;
+		}
+		count *= ax[a].count;
+	}
+	return count;
+}
+
+static void set_axis(struct os_opts * opts, int setting, int value) {
+	switch (setting) {
+	case AX_SLOT:   opts->time_slot = value; break;
+	case AX_CPUS:   opts->cpus = value; break;
+	case AX_RAM:    opts->memramsz = value; break;
+	case AX_SWAP:   opts->memswpsz = value; break;
+	case AX_BUDGET: opts->budget = value; break;
+	case AX_POLICY: opts->policy = value; break;
+	}
+}
+
+/* Configuration [i] of those [ax] span, the first setting varying the
+ * slowest */
+static void set_config(struct os_opts * opts, const struct axis * ax,
+		int naxes, long i) {
+	int a;
+
+	for (a = naxes - 1; a >= 0; a--) {
+		set_axis(opts, ax[a].setting, ax[a].values[i % ax[a].count]);
+		i /= ax[a].count;
+	}
+}
+
+static double elapsed(const struct timespec * start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void * pool_worker(void * args) {
+	struct run_pool * pool = (struct run_pool *)args;
+
+	while (1) {
+		struct timespec start;
+		struct sweep_run * run;
+
+		pthread_mutex_lock(&pool->lock);
+		int i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		if (i >= pool->count)
+			break;
+
+		/* The log of a run is of no use once it is summed up */
+		run = pool->runs[i];
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		run->ret = -1;
+		if ((run->opts.out = fopen("/dev/null", "w")) != NULL) {
+			run->ret = os_run(&run->opts, &run->sum);
+			fclose(run->opts.out);
+			run->opts.out = NULL;
+		}
+		run->secs = elapsed(&start);
+	}
+	return NULL;
+}
+
+/* Go through the [count] runs of [runs], [jobs] at a time, 0 for as
+ * many as there are host CPUs. Return the number of runs at a time */
+static int run_all(struct sweep_run ** runs, int count, int jobs) {
+	struct run_pool pool;
+	pthread_t * workers;
+	int i;
+
+	if (jobs <= 0)
+		jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs > count)
+		jobs = count;
+	if (jobs < 1)
+		jobs = 1;
+	pool.runs = runs;
+	pool.count = count;
+	pool.next = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+	workers = (pthread_t *)malloc(sizeof(pthread_t) * jobs);
+
+	for (i = 0; i < jobs; i++)
+		pthread_create(&workers[i], NULL, pool_worker, &pool);
+	for (i = 0; i < jobs; i++)
+		pthread_join(workers[i], NULL);
+
+	free(workers);
+	pthread_mutex_destroy(&pool.lock);
+	return jobs;
+}
+
+static void print_header(void) {
+	printf(" %5s %4s %9s %9s %6s %6s %8s %8s %7s %8s %8s %6s %6s %7s\n",
+	       "slot", "cpus", "ram", "swap", "budget", "policy", "admitted",
+	       "finished", "slots", "thruput", "mean", "p50", "p99", "secs");
+}
+
+/* A setting as run, '-' when it is the one of the configure file */
+static void print_setting(int value, int width) {
+	if (value > 0)
+		printf(" %*d", width, value);
+	else
+		printf(" %*s", width, "-");
+}
+
+/* Print a run, return 0 if it went through */
+static int print_run(const struct sweep_run * run) {
+	print_setting(run->opts.time_slot, 5);
+	print_setting(run->opts.cpus, 4);
+	print_setting(run->opts.memramsz, 9);
+	print_setting(run->opts.memswpsz, 9);
+	print_setting(run->opts.budget, 6);
+	printf(" %6s", sched_policy_name(run->opts.policy));
+	if (run->ret != 0) {
+		printf(" failed\n");
+		return -1;
+	}
+	printf(" %8lu %8lu %7lu %8.3f %8.1f %6lu %6lu %7.3f\n",
+	       (unsigned long)run->sum.admitted,
+	       (unsigned long)run->sum.finished,
+	       (unsigned long)run->sum.span, run->sum.throughput,
+	       run->sum.mean, (unsigned long)run->sum.p50,
+	       (unsigned long)run->sum.p99, run->secs);
+	return 0;
+}
+
+int os_sweep(const struct os_opts * opts, char ** axes, int naxes,
+		int jobs) {
+	struct axis ax[NUM_AXES];
+	struct timespec start;
+	struct sweep_run * runs;
+	struct sweep_run ** order;
+	long count;
+	int i, failed = 0;
+
+	if ((count = parse_axes(axes, naxes, ax)) < 0)
+		return -1;
+	runs = (struct sweep_run *)calloc(count, sizeof(struct sweep_run));
+	order = (struct sweep_run **)malloc(sizeof(*order) * count);
+	for (i = 0; i < count; i++) {
+		runs[i].opts = *opts;
+		set_config(&runs[i].opts, ax, naxes, i);
+		order[i] = &runs[i];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	code_cache_hold();
+	jobs = run_all(order, count, jobs);
+	code_cache_release();
+
+	print_header();
+	for (i = 0; i < count; i++) {
+		if (print_run(&runs[i]) != 0)
+			failed++;
+	}
+	printf("%ld runs, %d at a time, in %.3f s\n", count, jobs,
+	       elapsed(&start));
+
+	free(order);
+	free(runs);
+	return failed ? -1 : 0;
+}
+
+int tune_objective(const char * name) {
+	int o;
+
+	for (o = TUNE_MEAN; o <= TUNE_THROUGHPUT; o++) {
+		if (!strcmp(name, objective_names[o]))
+			return o;
+	}
+	return -1;
+}
+
+static double score(const struct sweep_run * run, int objective) {
+	switch (objective) {
+	case TUNE_MEAN: return run->sum.mean;
+	case TUNE_P99:  return (double)run->sum.p99;
+	default:        return -run->sum.throughput;
+	}
+}
+
+/* Best run first: one that went through, that finished the most
+ * processes, a process left behind counts for more than any time, then
+ * the best score */
+static int by_rank(const void * a, const void * b) {
+	const struct sweep_run * x = *(const struct sweep_run * const *)a;
+	const struct sweep_run * y = *(const struct sweep_run * const *)b;
+
+	if (x->ret != y->ret)
+		return x->ret == 0 ? -1 : 1;
+	if (x->sum.finished != y->sum.finished)
+		return x->sum.finished > y->sum.finished ? -1 : 1;
+	if (x->score != y->score)
+		return x->score < y->score ? -1 : 1;
+	return 0;
+}
+
+/* [x] is at least as good as [y] on the processes finished, the score,
+ * the CPUs and the RAM, and better on one of them */
+static int dominates(const struct sweep_run * x, const struct sweep_run * y) {
+	int cpus = (x->opts.cpus > y->opts.cpus) - (x->opts.cpus < y->opts.cpus);
+	int ram = (x->opts.memramsz > y->opts.memramsz) -
+		  (x->opts.memramsz < y->opts.memramsz);
+	int done = (x->sum.finished < y->sum.finished) -
+		   (x->sum.finished > y->sum.finished);
+	int score = (x->score > y->score) - (x->score < y->score);
+
+	if (x->ret != 0)
+		return 0;
+	if (y->ret != 0)
+		return 1;
+	if (cpus > 0 || ram > 0 || done > 0 || score > 0)
+		return 0;
+	return cpus < 0 || ram < 0 || done < 0 || score < 0;
+}
+
+/* xorshift64*, for the configurations drawn */
+static uint64_t tune_rand(uint64_t * seed) {
+	*seed ^= *seed >> 12;
+	*seed ^= *seed << 25;
+	*seed ^= *seed >> 27;
+	return *seed * 0x2545F4914F6CDD1DULL;
+}
+
+int os_tune(const struct os_opts * opts, char ** axes, int naxes,
+		int jobs, int objective) {
+	/* Without settings, the ones the workload does not fix */
+	char slots[] = "slot=1,2,4,8,16";
+	char budgets[] = "budget=10,35,70,140";
+	char * defaults[] = { slots, budgets };
+	struct axis ax[NUM_AXES];
+	struct timespec start;
+	struct sweep_run * runs;
+	struct sweep_run ** alive;
+	uint64_t seed = opts->seed;
+	long grid, workload;
+	int n, r, rungs, i, j;
+
+	if (naxes == 0) {
+		axes = defaults;
+		naxes = 2;
+	}
+	if ((grid = parse_axes(axes, naxes, ax)) < 0)
+		return -1;
+	workload = os_workload(opts);
+
+	/* The whole grid if it is small enough, else configurations drawn
+	 * from it, each one once */
+	n = grid < TUNE_CANDIDATES ? (int)grid : TUNE_CANDIDATES;
+	runs = (struct sweep_run *)calloc(n, sizeof(struct sweep_run));
+	alive = (struct sweep_run **)malloc(sizeof(*alive) * n);
+	long * picked = (long *)malloc(sizeof(long) * n);
+	for (i = 0; i < n; i++) {
+		long c = i;
+
+		while (grid > TUNE_CANDIDATES) {
+			c = (long)(tune_rand(&seed) % (uint64_t)grid);
+			for (j = 0; j < i && picked[j] != c; j++)
+				;
+			if (j == i)
+				break;
+		}
+		picked[i] = c;
+		runs[i].opts = *opts;
+		set_config(&runs[i].opts, ax, naxes, c);
+		alive[i] = &runs[i];
+	}
+	free(picked);
+
+	/* Rounds while a smaller round keeps a candidate and enough
+	 * arrivals */
+	long div = 1;
+	rungs = 1;
+	while (workload > 0 && div * TUNE_ETA <= n &&
+	       workload / (div * TUNE_ETA) >= TUNE_MIN_ARRIVALS) {
+		div *= TUNE_ETA;
+		rungs++;
+	}
+
+	printf("Tuning %s over %d of %ld configurations, %d round%s\n",
+	       objective_names[objective], n, grid, rungs,
+	       rungs > 1 ? "s" : "");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	code_cache_hold();
+	for (r = 0; r < rungs; r++, div /= TUNE_ETA) {
+		struct timespec round;
+		unsigned long limit = div > 1 ? workload / div : 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &round);
+		for (i = 0; i < n; i++)
+			alive[i]->opts.limit = limit;
+		jobs = run_all(alive, n, jobs);
+		for (i = 0; i < n; i++)
+			alive[i]->score = score(alive[i], objective);
+		qsort(alive, n, sizeof(*alive), by_rank);
+		if (limit > 0)
+			printf("Round %d: %d configurations on %lu arrivals"
+			       " in %.3f s\n", r, n, limit, elapsed(&round));
+		else
+			printf("Round %d: %d configurations on the whole"
+			       " workload in %.3f s\n", r, n, elapsed(&round));
+		if (r < rungs - 1)
+			n = (n + TUNE_ETA - 1) / TUNE_ETA;
+	}
+	code_cache_release();
+
+	/* The configurations of the last round no other one beats on
+	 * every count, best first */
+	printf("Pareto-best configurations, best %s first:\n",
+	       objective_names[objective]);
+	print_header();
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n && !dominates(alive[j], alive[i]); j++)
+			;
+		if (j == n)
+			print_run(alive[i]);
+	}
+	printf("%d runs at a time, in %.3f s\n", jobs, elapsed(&start));
+
+	i = alive[0]->ret;
+	free(alive);
+	free(runs);
+	return i;
+}
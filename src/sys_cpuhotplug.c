@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "common.h"
+#include "syscall.h"
+#include "cpu.h"
+
+/*
+ * sys_cpuhotplug - bring a simulated CPU online or offline
+ * @regs->a1: CPU id
+ * @regs->a2: 1 to bring the CPU online, 0 to take it offline
+ */
+int __sys_cpuhotplug(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+   int id = (int)regs->a1;
+
+   (void)pid;
+
+   if (regs->a2)
+      return cpu_online(krnl, id);
+
+   return cpu_offline(krnl, id);
+}
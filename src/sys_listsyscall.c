@@ -13,7 +13,7 @@
 int __sys_listsyscall(struct krnl_t *krnl, uint32_t pid, struct sc_regs* reg)
 {
    for (int i = 0; i < syscall_table_size; i++)
-       printf("%s\n",sys_call_table[i]); 
+       fprintf(krnl->out, "%s\n",sys_call_table[i]); 
 
    return 0;
 }
@@ -30,7 +30,8 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
    /* TODO THIS DUMMY CREATE EMPTY PROC TO AVOID COMPILER NOTIFY 
     *      need to be eliminated
 	*/
-   struct pcb_t *caller = malloc(sizeof(struct pcb_t));
+   struct pcb_t *caller = calloc(1, sizeof(struct pcb_t));
+   caller->krnl = krnl;
 
    /*
     * @bksysnet: Please note in the dual spacing design
@@ -69,6 +70,7 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
             break;
    }
    
+   free(caller);
    return 0;
 }
 
@@ -102,8 +102,6 @@ Logic Xử lý chính:
  */
 int __sys_xxxhandler(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
 {
-    (void)krnl; /* hiện tại không cần dùng đến kernel pointer */
-
     /* Thống kê đơn giản, lưu nội bộ ở handler :
        - total_calls: tổng số lần syscall này được gọi
        - per-pid: đếm số lần theo từng PID (bảng nhỏ, linear search) */
@@ -146,10 +144,10 @@ int __sys_xxxhandler(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
     slots[found_idx].cnt++;
 
     /* In tham số thứ nhất (regs->a1) theo định dạng kiến trúc (32/64-bit) */
-    printf("The first system call parameter " FORMAT_ARG "\n", (arg_t)regs->a1);
+    fprintf(krnl->out, "The first system call parameter " FORMAT_ARG "\n", (arg_t)regs->a1);
 
     /* In thống kê */
-    printf("[sys_xxxhandler] pid=%u | pid_calls=%llu | total_calls=%llu\n",
+    fprintf(krnl->out, "[sys_xxxhandler] pid=%u | pid_calls=%llu | total_calls=%llu\n",
            pid,
            (unsigned long long)slots[found_idx].cnt,
            (unsigned long long)total_calls);
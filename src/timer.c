@@ -4,53 +4,165 @@
 #include <stdlib.h>
 #include <inttypes.h> 
 
-static pthread_t _timer;
-
 struct timer_id_container_t {
 	struct timer_id_t id;
 	struct timer_id_container_t * next;
 };
 
-static struct timer_id_container_t * dev_list = NULL;
+struct ktimer_t {
+	pthread_t thread;
+	struct timer_id_container_t * dev_list;
+	/* Devices may be attached while the timer runs (CPU hotplug) */
+	pthread_mutex_t dev_lock;
+	uint64_t time;
+	int stop;
+	int started;
+	FILE * out;
+	/* Turns of the devices, see timer_ordered() */
+	int ordered;
+	int bulk;	// See timer_bulk()
+	pthread_mutex_t turn_lock;
+	pthread_cond_t turn_cond;
+	/* Called once at the start of slot at_time, see timer_at() */
+	void (*at_fn)(void *);
+	void * at_arg;
+	uint64_t at_time;
+};
+
+/* Wait for the devices from [temp] on, up to [last], to be done with
+ * the current slot. Return how many there are, in [fsh] those that
+ * have finished */
+static int wait_devices(struct timer_id_container_t * temp,
+		struct timer_id_container_t * last, int * fsh) {
+	int event = 0;
+
+	for (; temp != last; temp = temp->next) {
+		pthread_mutex_lock(&temp->id.event_lock);
+		while (!temp->id.done && !temp->id.fsh) {
+			pthread_cond_wait(
+				&temp->id.event_cond,
+				&temp->id.event_lock
+			);
+		}
+		if (temp->id.fsh) {
+			(*fsh)++;
+		}
+		event++;
+		pthread_mutex_unlock(&temp->id.event_lock);
+	}
+	return event;
+}
+
+/* Slots after the current one every device still attached sleeps
+ * through, up to the one before that of timer_at() */
+static uint64_t idle_slots(struct ktimer_t * timer) {
+	struct timer_id_container_t * temp;
+	uint64_t idle = UINT64_MAX;
+
+	pthread_mutex_lock(&timer->dev_lock);
+	temp = timer->dev_list;
+	pthread_mutex_unlock(&timer->dev_lock);
+	for (; temp != NULL && idle > 0; temp = temp->next) {
+		if (temp->id.fsh)
+			continue;
+		pthread_mutex_lock(&temp->id.timer_lock);
+		if (temp->id.skip < idle)
+			idle = temp->id.skip;
+		pthread_mutex_unlock(&temp->id.timer_lock);
+	}
+	if (idle == UINT64_MAX)
+		return 0;
+	if (timer->at_fn != NULL && timer->at_time > timer->time &&
+	    idle > timer->at_time - timer->time - 1)
+		idle = timer->at_time - timer->time - 1;
+	return idle;
+}
 
-static uint64_t _time;
+/* Let [idle] slots pass with every device asleep */
+static void pass_slots(struct ktimer_t * timer, uint64_t idle) {
+	struct timer_id_container_t * temp;
 
-static int timer_started = 0;
-static int timer_stop = 0;
+	pthread_mutex_lock(&timer->dev_lock);
+	temp = timer->dev_list;
+	pthread_mutex_unlock(&timer->dev_lock);
+	for (; temp != NULL; temp = temp->next) {
+		if (temp->id.fsh)
+			continue;
+		pthread_mutex_lock(&temp->id.timer_lock);
+		temp->id.skip -= idle;
+		pthread_mutex_unlock(&temp->id.timer_lock);
+	}
+	timer->time += idle;
+}
 
+static void log_slot(struct ktimer_t * timer) {
+	//printf("Time slot %3llu\n", current_time());
+	fprintf(timer->out, "Time slot %3lu\n", (unsigned long)timer->time);
+}
 
 static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		//printf("Time slot %3llu\n", current_time());
-		printf("Time slot %3lu\n", (unsigned long)current_time());
+	struct ktimer_t * timer = (struct ktimer_t *)args;
+	while (!timer->stop) {
+		/* An ordered timer has logged the slot before starting it */
+		if (!timer->ordered)
+			log_slot(timer);
 		int fsh = 0;
 		int event = 0;
 		/* Wait for all devices have done the job in current
 		 * time slot */
 		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
-			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
+		struct timer_id_container_t * first;
+		pthread_mutex_lock(&timer->dev_lock);
+		first = timer->dev_list;
+		pthread_mutex_unlock(&timer->dev_lock);
+		event = wait_devices(first, NULL, &fsh);
+		/* The devices attached during the slot are part of it, and
+		 * it may not end under their feet */
+		while (1) {
+			pthread_mutex_lock(&timer->dev_lock);
+			temp = timer->dev_list;
+			pthread_mutex_unlock(&timer->dev_lock);
+			if (temp == first)
+				break;
+			event += wait_devices(temp, first, &fsh);
+			first = temp;
+		}
+
+		/* The slots every device sleeps through go by at once,
+		 * unlogged, see timer_bulk() */
+		if (timer->bulk && fsh < event) {
+			uint64_t idle = idle_slots(timer);
+			if (idle > 0)
+				pass_slots(timer, idle);
 		}
 
 		/* Increase the time slot */
-		_time++;
+		timer->time++;
+
+		/* Every device is done with the slot before, none is
+		 * running meanwhile */
+		if (timer->at_fn != NULL && timer->time == timer->at_time &&
+		    fsh < event)
+			timer->at_fn(timer->at_arg);
 		
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
+		if (timer->ordered && fsh < event)
+			log_slot(timer);
+
+		/* Let devices continue their job. A device attached during
+		 * this slot is already in the list and joins from now on */
+		pthread_mutex_lock(&timer->dev_lock);
+		temp = timer->dev_list;
+		pthread_mutex_unlock(&timer->dev_lock);
+		for (; temp != NULL; temp = temp->next) {
 			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
+			if (temp->id.skip > 0) {
+				/* Keep the device parked, its job is
+				 * already done for this slot too */
+				temp->id.skip--;
+			}else{
+				temp->id.done = 0;
+				pthread_cond_signal(&temp->id.timer_cond);
+			}
 			pthread_mutex_unlock(&temp->id.timer_lock);
 		}
 		if (fsh == event) {
@@ -61,6 +173,25 @@ static void * timer_routine(void * args) {
 }
 
 void next_slot(struct timer_id_t * timer_id) {
+	next_slots(timer_id, 1);
+}
+
+void next_slots(struct timer_id_t * timer_id, uint64_t n) {
+	struct ktimer_t * timer = timer_id->timer;
+
+	if (n == 0) {
+		return;
+	}
+	pthread_mutex_lock(&timer_id->timer_lock);
+	timer_id->skip = n - 1;
+	pthread_mutex_unlock(&timer_id->timer_lock);
+	if (timer->ordered) {
+		pthread_mutex_lock(&timer->turn_lock);
+		timer_id->turn = timer->time + n;
+		pthread_cond_broadcast(&timer->turn_cond);
+		pthread_mutex_unlock(&timer->turn_lock);
+	}
+
 	/* Tell to timer that we have done our job in current slot */
 	pthread_mutex_lock(&timer_id->event_lock);
 	timer_id->done = 1;
@@ -78,59 +209,153 @@ void next_slot(struct timer_id_t * timer_id) {
 	pthread_mutex_unlock(&timer_id->timer_lock);
 }
 
-uint64_t current_time() {
-	return _time;
+uint64_t current_time(const struct ktimer_t * timer) {
+	return timer->time;
 }
 
-void start_timer() {
-	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+struct ktimer_t * timer_new(FILE * out) {
+	struct ktimer_t * timer =
+		(struct ktimer_t *)calloc(1, sizeof(struct ktimer_t));
+	pthread_mutex_init(&timer->dev_lock, NULL);
+	pthread_mutex_init(&timer->turn_lock, NULL);
+	pthread_cond_init(&timer->turn_cond, NULL);
+	timer->out = out;
+	return timer;
+}
+
+void timer_ordered(struct ktimer_t * timer) {
+	timer->ordered = 1;
+}
+
+void timer_bulk(struct ktimer_t * timer) {
+	timer->bulk = 1;
+}
+
+/* Whether [a] takes its turn in slot [time] before [b] */
+static int turn_before(const struct timer_id_t * a,
+		const struct timer_id_t * b, uint64_t time) {
+	int late_a = (a->joined == time);
+	int late_b = (b->joined == time);
+
+	if (late_a != late_b)
+		return late_b;
+	return a->order < b->order;
+}
+
+/* Turn lock held */
+static int has_turn(struct ktimer_t * timer, struct timer_id_t * timer_id) {
+	struct timer_id_container_t * temp;
+
+	pthread_mutex_lock(&timer->dev_lock);
+	temp = timer->dev_list;
+	pthread_mutex_unlock(&timer->dev_lock);
+	for (; temp != NULL; temp = temp->next) {
+		if (&temp->id != timer_id && temp->id.turn <= timer->time &&
+		    turn_before(&temp->id, timer_id, timer->time))
+			return 0;
+	}
+	return 1;
+}
+
+void timer_turn(struct timer_id_t * timer_id) {
+	struct ktimer_t * timer = timer_id->timer;
+
+	if (!timer->ordered)
+		return;
+	pthread_mutex_lock(&timer->turn_lock);
+	while (!has_turn(timer, timer_id))
+		pthread_cond_wait(&timer->turn_cond, &timer->turn_lock);
+	pthread_mutex_unlock(&timer->turn_lock);
+}
+
+void timer_pass(struct timer_id_t * timer_id) {
+	struct ktimer_t * timer = timer_id->timer;
+
+	if (!timer->ordered)
+		return;
+	pthread_mutex_lock(&timer->turn_lock);
+	timer_id->turn = timer->time + 1;
+	pthread_cond_broadcast(&timer->turn_cond);
+	pthread_mutex_unlock(&timer->turn_lock);
+}
+
+void timer_set(struct ktimer_t * timer, uint64_t time) {
+	timer->time = time;
+}
+
+void timer_at(struct ktimer_t * timer, uint64_t time,
+		void (*fn)(void *), void * arg) {
+	timer->at_fn = fn;
+	timer->at_arg = arg;
+	timer->at_time = time;
+}
+
+void start_timer(struct ktimer_t * timer) {
+	timer->started = 1;
+	if (timer->ordered)
+		log_slot(timer);
+	pthread_create(&timer->thread, NULL, timer_routine, timer);
 }
 
 void detach_event(struct timer_id_t * event) {
+	struct ktimer_t * timer = event->timer;
+
+	if (timer->ordered) {
+		pthread_mutex_lock(&timer->turn_lock);
+		event->turn = UINT64_MAX;
+		pthread_cond_broadcast(&timer->turn_cond);
+		pthread_mutex_unlock(&timer->turn_lock);
+	}
 	pthread_mutex_lock(&event->event_lock);
 	event->fsh = 1;
 	pthread_cond_signal(&event->event_cond);
 	pthread_mutex_unlock(&event->event_lock);
 }
 
-struct timer_id_t * attach_event() {
-	if (timer_started) {
-		return NULL;
-	}else{
-		struct timer_id_container_t * container =
-			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
-			);
-		container->id.done = 0;
-		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
-		if (dev_list == NULL) {
-			dev_list = container;
-			dev_list->next = NULL;
-		}else{
-			container->next = dev_list;
-			dev_list = container;
-		}
-		return &(container->id);
-	}
+struct timer_id_t * attach_event(struct ktimer_t * timer, int order) {
+	struct timer_id_container_t * container =
+		(struct timer_id_container_t*)malloc(
+			sizeof(struct timer_id_container_t)		
+		);
+	container->id.done = 0;
+	container->id.fsh = 0;
+	container->id.skip = 0;
+	container->id.order = order;
+	container->id.timer = timer;
+	pthread_cond_init(&container->id.event_cond, NULL);
+	pthread_mutex_init(&container->id.event_lock, NULL);
+	pthread_cond_init(&container->id.timer_cond, NULL);
+	pthread_mutex_init(&container->id.timer_lock, NULL);
+
+	/* The list is only ever pushed at its head, so the timer can keep
+	 * walking a snapshot of it while a device is being attached */
+	pthread_mutex_lock(&timer->turn_lock);
+	container->id.turn = timer->time;
+	container->id.joined = timer->started ? timer->time : UINT64_MAX;
+	pthread_mutex_lock(&timer->dev_lock);
+	container->next = timer->dev_list;
+	timer->dev_list = container;
+	pthread_mutex_unlock(&timer->dev_lock);
+	pthread_mutex_unlock(&timer->turn_lock);
+	return &(container->id);
 }
 
-void stop_timer() {
-	timer_stop = 1;
-	pthread_join(_timer, NULL);
-	while (dev_list != NULL) {
-		struct timer_id_container_t * temp = dev_list;
-		dev_list = dev_list->next;
+void stop_timer(struct ktimer_t * timer) {
+	timer->stop = 1;
+	pthread_join(timer->thread, NULL);
+	while (timer->dev_list != NULL) {
+		struct timer_id_container_t * temp = timer->dev_list;
+		timer->dev_list = temp->next;
 		pthread_cond_destroy(&temp->id.event_cond);
 		pthread_mutex_destroy(&temp->id.event_lock);
 		pthread_cond_destroy(&temp->id.timer_cond);
 		pthread_mutex_destroy(&temp->id.timer_lock);
 		free(temp);
 	}
+	pthread_mutex_destroy(&timer->dev_lock);
+	pthread_mutex_destroy(&timer->turn_lock);
+	pthread_cond_destroy(&timer->turn_cond);
+	free(timer);
 }
 
 
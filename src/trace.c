@@ -0,0 +1,226 @@
+
+#include "trace.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+enum { F_ARRIVAL, F_BURST, F_MEM, F_PRIO, NUM_FIELDS };
+
+static const char * field_names[NUM_FIELDS] = {
+	"arrival", "burst", "mem", "prio"
+};
+
+#define TRACE_LINE	512	/* Longest CSV line */
+#define TRACE_COLS	32	/* CSV columns looked at */
+#define TRACE_TOKEN	32	/* Longest JSON key or number */
+
+struct trace {
+	FILE * file;
+	int json;
+	int record;		// CSV line or JSON object, for messages
+	int started;		// CSV: past the place of the header
+	int col[NUM_FIELDS];	// CSV column of each field, -1 if none
+};
+
+static int field_index(const char * name) {
+	int f;
+
+	for (f = 0; f < NUM_FIELDS; f++) {
+		if (!strcasecmp(name, field_names[f]))
+			return f;
+	}
+	return -1;
+}
+
+static void set_field(struct trace_job * job, int f, double v) {
+	unsigned long u = v > 0 ? (unsigned long)v : 0;
+
+	switch (f) {
+	case F_ARRIVAL: job->arrival = u; break;
+	case F_BURST:   job->burst = u; break;
+	case F_MEM:     job->mem = u; break;
+	case F_PRIO:    job->prio = u; break;
+	}
+}
+
+/* Strip the blanks and quotes around a CSV cell */
+static char * trim(char * s) {
+	char * e;
+
+	while (isspace((unsigned char)*s) || *s == '"')
+		s++;
+	e = s + strlen(s);
+	while (e > s && (isspace((unsigned char)e[-1]) || e[-1] == '"'))
+		e--;
+	*e = '\0';
+	return s;
+}
+
+static int csv_next(struct trace * t, struct trace_job * job) {
+	char buf[TRACE_LINE];
+
+	while (fgets(buf, sizeof(buf), t->file) != NULL) {
+		char * cols[TRACE_COLS];
+		char * p = buf;
+		int n = 0, f, ok = 1;
+
+		t->record++;
+		while (isspace((unsigned char)*p))
+			p++;
+		if (*p == '\0' || *p == '#')
+			continue;
+		while (n < TRACE_COLS) {
+			char * comma = strchr(p, ',');
+			if (comma != NULL)
+				*comma = '\0';
+			cols[n++] = trim(p);
+			if (comma == NULL)
+				break;
+			p = comma + 1;
+		}
+
+		/* A first line that is not a number names the columns */
+		if (!t->started && !isdigit((unsigned char)cols[0][0]) &&
+		    cols[0][0] != '.') {
+			t->started = 1;
+			for (f = 0; f < NUM_FIELDS; f++)
+				t->col[f] = -1;
+			while (n-- > 0) {
+				f = field_index(cols[n]);
+				if (f >= 0)
+					t->col[f] = n;
+			}
+			continue;
+		}
+		t->started = 1;
+
+		memset(job, 0, sizeof(*job));
+		for (f = 0; f < NUM_FIELDS && ok; f++) {
+			char * end;
+			double v;
+
+			if (t->col[f] < 0)
+				continue;
+			if (t->col[f] >= n) {
+				ok = 0;
+				break;
+			}
+			v = strtod(cols[t->col[f]], &end);
+			ok = end != cols[t->col[f]] && *end == '\0';
+			set_field(job, f, v);
+		}
+		if (ok)
+			return 0;
+		printf("Malformed trace record at line %d, skipped\n", t->record);
+	}
+	return -1;
+}
+
+static int skip_space(FILE * file) {
+	int c;
+
+	do {
+		c = getc(file);
+	} while (c != EOF && isspace(c));
+	return c;
+}
+
+/* Read a JSON string, its opening quote read, into [buf] (truncated) */
+static int json_string(FILE * file, char * buf, size_t size) {
+	size_t n = 0;
+	int c;
+
+	while ((c = getc(file)) != EOF && c != '"') {
+		if (c == '\\' && (c = getc(file)) == EOF)
+			break;
+		if (n + 1 < size)
+			buf[n++] = (char)c;
+	}
+	buf[n] = '\0';
+	return c == '"' ? 0 : -1;
+}
+
+static int json_next(struct trace * t, struct trace_job * job) {
+	char key[TRACE_TOKEN];
+	char val[TRACE_TOKEN];
+	int c = skip_space(t->file);
+
+	if (c == ',')
+		c = skip_space(t->file);
+	if (c == ']' || c == EOF)
+		return -1;
+	t->record++;
+	if (c != '{')
+		goto bad;
+
+	memset(job, 0, sizeof(*job));
+	c = skip_space(t->file);
+	while (c != '}') {
+		if (c == ',') {
+			c = skip_space(t->file);
+			continue;
+		}
+		if (c != '"' || json_string(t->file, key, sizeof(key)) != 0 ||
+		    skip_space(t->file) != ':')
+			goto bad;
+
+		/* Numbers go to their field, other values are skipped */
+		c = skip_space(t->file);
+		if (c == '"') {
+			if (json_string(t->file, val, sizeof(val)) != 0)
+				goto bad;
+		}else{
+			size_t n = 0;
+
+			while (c != EOF && (isalnum(c) || strchr("+-.", c))) {
+				if (n + 1 < sizeof(val))
+					val[n++] = (char)c;
+				c = getc(t->file);
+			}
+			val[n] = '\0';
+			ungetc(c, t->file);
+			if (n == 0)
+				goto bad;
+			int f = field_index(key);
+			if (f >= 0)
+				set_field(job, f, strtod(val, NULL));
+		}
+		c = skip_space(t->file);
+	}
+	return 0;
+
+bad:
+	/* No way to find the next record again */
+	printf("Malformed trace record %d, end of trace\n", t->record);
+	return -1;
+}
+
+struct trace * trace_open(const char * path) {
+	struct trace * t;
+	FILE * file;
+	int c, f;
+
+	if ((file = fopen(path, "r")) == NULL)
+		return NULL;
+	t = (struct trace *)calloc(1, sizeof(struct trace));
+	t->file = file;
+	c = skip_space(file);
+	if (c == '[')
+		t->json = 1;
+	else
+		ungetc(c, file);
+	for (f = 0; f < NUM_FIELDS; f++)
+		t->col[f] = f;
+	return t;
+}
+
+int trace_next(struct trace * t, struct trace_job * job) {
+	return t->json ? json_next(t, job) : csv_next(t, job);
+}
+
+void trace_close(struct trace * t) {
+	fclose(t->file);
+	free(t);
+}